@@ -2,26 +2,77 @@
 #define ALEXAAGENT__AGENT_H
 
 #include <fstream>
+#include <sstream>
 
+#include "pcm_cache.h"
+#include "playlist.h"
 #include "session.h"
 #include "tiny_http.h"
 
 class t_agent
 {
-	static void f_load_sound(ALuint a_buffer, const std::string& a_path)
+	struct t_sound
 	{
-		t_url_audio_source source(a_path.c_str());
-		t_audio_decoder decoder(source);
-		ALenum format = AL_FORMAT_MONO8;
-		std::vector<char> data;
-		ALsizei rate = 0;
-		decoder([&](size_t a_channels, size_t a_bytes, const char* a_p, size_t a_n, size_t a_rate)
+		std::string v_path;
+		t_pcm_cache::t_key v_key;
+		bool v_cacheable;
+		t_pcm_mapping v_mapping;
+		size_t v_channels = 0;
+		size_t v_bytes = 0;
+		size_t v_rate = 0;
+		std::vector<char> v_data;
+		std::exception_ptr v_error;
+
+		void f_decode(bool a_float32)
 		{
-			format = a_channels == 1 ? (a_bytes == 1 ? AL_FORMAT_MONO8 : AL_FORMAT_MONO16) : (a_bytes == 1 ? AL_FORMAT_STEREO8 : AL_FORMAT_STEREO16);
-			data.insert(data.end(), a_p, a_p + a_n);
-			rate = a_rate;
-		});
-		alBufferData(a_buffer, format, data.data(), data.size(), rate);
+			try {
+				t_url_audio_source source(v_path.c_str());
+				t_audio_decoder decoder(source, a_float32);
+				decoder([&](size_t a_channels, size_t a_bytes, const char* a_p, size_t a_n, size_t a_rate)
+				{
+					v_channels = a_channels;
+					v_bytes = a_bytes;
+					v_rate = a_rate;
+					v_data.insert(v_data.end(), a_p, a_p + a_n);
+				});
+			} catch (...) {
+				v_error = std::current_exception();
+			}
+		}
+	};
+
+	// Maps cached PCM where the sound file is unchanged, and decodes the rest in parallel.
+	void f_load_sounds(const picojson::value& a_sounds)
+	{
+		auto t0 = std::chrono::steady_clock::now();
+		t_sound sounds[4];
+		sounds[0].v_path = a_sounds / "timer" / "foreground"_jss;
+		sounds[1].v_path = a_sounds / "timer" / "background"_jss;
+		sounds[2].v_path = a_sounds / "alarm" / "foreground"_jss;
+		sounds[3].v_path = a_sounds / "alarm" / "background"_jss;
+		t_pcm_cache cache("session");
+		bool float32 = f_al_float32();
+		std::vector<std::thread> threads;
+		for (auto& x : sounds) {
+			x.v_cacheable = t_pcm_cache::f_key(x.v_path, x.v_key);
+			if (!x.v_cacheable || !cache.f_load(x.v_path, x.v_key, x.v_mapping)) threads.emplace_back(&t_sound::f_decode, &x, float32);
+		}
+		for (auto& x : threads) x.join();
+		for (size_t i = 0; i < 4; ++i) {
+			auto& x = sounds[i];
+			if (x.v_mapping) {
+				alBufferData(v_sounds[i], f_al_format(x.v_mapping.v_channels, x.v_mapping.v_bytes), x.v_mapping.v_data, x.v_mapping.v_size, x.v_mapping.v_rate);
+				continue;
+			}
+			if (x.v_error) std::rethrow_exception(x.v_error);
+			alBufferData(v_sounds[i], x.v_channels > 0 ? f_al_format(x.v_channels, x.v_bytes) : AL_FORMAT_MONO8, x.v_data.data(), x.v_data.size(), x.v_rate);
+			if (x.v_cacheable) try {
+				cache.f_store(x.v_path, x.v_key, x.v_channels, x.v_bytes, x.v_rate, x.v_data.data(), x.v_data.size());
+			} catch (std::exception& e) {
+				if (v_log) v_log(e_severity__ERROR) << "caching " << x.v_path << ": " << e.what() << std::endl;
+			}
+		}
+		if (v_log) v_log(e_severity__INFORMATION) << "loaded sounds in " << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - t0).count() << " ms, " << (4 - threads.size()) << " of 4 cached." << std::endl;
 	}
 
 	ALCdevice* v_device;
@@ -29,6 +80,9 @@ class t_agent
 	const picojson::value& v_profile;
 	ALuint v_sounds[4];
 	std::unique_ptr<t_scheduler> v_scheduler;
+	// Declared before the session, whose opener threads use them until it is destroyed.
+	t_http_pool v_http;
+	t_playlist_resolver v_playlists{std::chrono::minutes(10), 64, &v_http};
 	std::unique_ptr<t_session> v_session;
 	size_t v_refresh_retry_interval = 1;
 
@@ -59,6 +113,9 @@ class t_agent
 			v_session->f_content_can_play_in_background(options / "content_can_play_in_background"_jsb);
 			v_session->f_capture_threshold(options / "capture_threshold"_jsn);
 			v_session->f_capture_auto(options / "capture_auto"_jsb);
+			v_session->f_audio_convert(options * "audio_convert" | false);
+			v_session->f_decode_ahead(options * "decode_ahead" | false);
+			v_session->f_attached_buffer(static_cast<size_t>(options * "attached_buffer" | 32768.0));
 		} catch (std::exception& e) {
 			if (v_log) v_log(e_severity__ERROR) << "loading session/options.json: " << e.what() << std::endl;
 		}
@@ -100,7 +157,10 @@ class t_agent
 				{"alerts_duration", picojson::value(static_cast<double>(v_session->f_alerts_duration()))},
 				{"content_can_play_in_background", picojson::value(v_session->f_content_can_play_in_background())},
 				{"capture_threshold", picojson::value(static_cast<double>(v_session->f_capture_threshold()))},
-				{"capture_auto", picojson::value(v_session->f_capture_auto())}
+				{"capture_auto", picojson::value(v_session->f_capture_auto())},
+				{"audio_convert", picojson::value(v_session->f_audio_convert())},
+				{"decode_ahead", picojson::value(v_session->f_decode_ahead())},
+				{"attached_buffer", picojson::value(static_cast<double>(v_session->f_attached_buffer()))}
 			}).serialize(std::ostreambuf_iterator<char>(s), true);
 			if (v_options_changed) v_options_changed();
 		};
@@ -124,100 +184,78 @@ class t_agent
 			}).serialize(std::ostreambuf_iterator<char>(s), true);
 			if (v_options_changed) v_options_changed();
 		};
-		v_session->v_open_audio_by_url = [this, open = v_session->v_open_audio_by_url](auto& a_url)
+		v_session->v_open_audio_by_url = [this, open = v_session->v_open_audio_by_url](auto& a_url, auto& a_cancelled)
 		{
+			t_playlist playlist;
+			if (!v_playlists.f_cached(a_url, playlist)) return open(a_url, a_cancelled);
+			if (v_log) v_log(e_severity__TRACE) << "resolved from cache: " << a_url << std::endl;
 			try {
-				auto url = a_url;
-				while (true) {
-					if (v_log) v_log(e_severity__TRACE) << "opening: " << url.c_str() << std::endl;
-					try {
-						return open(url);
-					} catch (std::exception& e) {
-						if (v_log) v_log(e_severity__INFORMATION) << "caught: " << e.what() << std::endl << "trying to resolve..." << std::endl;
-						boost::asio::io_service io;
-						t_http10 http(url);
-						t_audio_source* source = nullptr;
-						http("GET")(io, [&](auto& a_socket)
-						{
-							if (http.v_code != 200) throw std::runtime_error("invalid code");
-							std::smatch match;
-							std::regex content_type{"Content-Type:\\s*\\S+/([^\\s;]+)\\s*;?.*\r"};
-							for (auto& x : http.v_headers) if (std::regex_match(x, match, content_type)) break;
-							if (match.empty()) throw std::runtime_error("no Content-Type found");
-							boost::system::error_code ec;
-							if (match[1] == "x-mpegurl") {
-								if (v_log) v_log(e_severity__TRACE) << "found x-mpegurl." << std::endl;
-								boost::asio::read_until(a_socket, http.v_buffer, '\n', ec);
-								if (ec && ec != boost::asio::error::eof) throw boost::system::system_error(ec);
-								std::string line;
-								std::getline(std::istream(&http.v_buffer), line);
-								if (!std::regex_match(line, match, std::regex{"\\s*(https?://\\S+)\\s*\r?"})) throw std::runtime_error("invalid url");
-								url = match[1];
-							} else if (match[1] == "x-scpls") {
-								if (v_log) v_log(e_severity__TRACE) << "found x-scpls." << std::endl;
-								boost::asio::read(a_socket, http.v_buffer, ec);
-								if (ec && ec != boost::asio::error::eof) throw boost::system::system_error(ec);
-								auto buffer = std::make_shared<boost::asio::streambuf>();
-								std::ostream stream(buffer.get());
-								stream <<
-								"#EXTM3U\n"
-								"#EXT-X-TARGETDURATION:0\n";
-								std::regex file{"File\\d+\\s*=\\s*(https?://\\S+)\\s*\r?"};
-								std::string line;
-								while (std::getline(std::istream(&http.v_buffer), line))
-									if (std::regex_match(line, match, file)) stream << "#EXTINF:0\n" << match[1] << '\n';
-								stream << "#EXT-X-ENDLIST\n";
-								source = new t_callback_audio_source([buffer](auto a_p, auto a_n)
-								{
-									return buffer->sgetn(reinterpret_cast<char*>(a_p), a_n);
-								});
-							} else {
-								throw std::runtime_error("unknown Content-Type: " + match[1].str());
-							}
-						});
-						if (source) return source;
-					}
-				}
+				return playlist.v_manifest.empty() ? open(playlist.v_url, a_cancelled) : f_manifest_audio_source(playlist.v_manifest, a_cancelled);
 			} catch (std::exception& e) {
-				if (v_log) v_log(e_severity__ERROR) << "caught: " << e.what() << std::endl;
-				throw nullptr;
+				if (*a_cancelled) throw;
+				v_playlists.f_cache().f_forget(a_url);
+				return open(a_url, a_cancelled);
 			}
 		};
+		v_session->v_resolve_audio_url = [this](auto& a_url, auto&& a_done)
+		{
+			v_playlists(v_scheduler->f_io(), a_url, [this, done = std::make_shared<t_session::t_resolved>(std::move(a_done))](auto&& a_playlist, auto a_error)
+			{
+				v_scheduler->dispatch([this, done, playlist = std::move(a_playlist), a_error]
+				{
+					if (v_log) v_log(e_severity__TRACE) << "playlists: " << v_playlists.f_hits() << " hits, " << v_playlists.f_misses() << " misses, " << v_playlists.f_cache().f_size() << " cached, " << v_playlists.f_cache().f_expirations() << " expired, " << v_playlists.f_cache().f_evictions() << " evicted." << std::endl;
+					if (a_error)
+						(*done)(std::string(), nullptr, a_error);
+					else if (playlist.v_manifest.empty())
+						(*done)(playlist.v_url, nullptr, nullptr);
+					else
+						(*done)(std::string(), [manifest = playlist.v_manifest](auto& a_cancelled)
+						{
+							return f_manifest_audio_source(manifest, a_cancelled);
+						}, nullptr);
+				});
+			});
+		};
 	}
 	template<typename T_done>
 	void f_grant(std::map<std::string, std::string>&& a_query, T_done a_done)
 	{
 		a_query.emplace("client_id", v_profile / "client_id"_jss);
 		a_query.emplace("client_secret", v_profile / "client_secret"_jss);
-		auto http = std::make_shared<t_http10>("https://api.amazon.com/auth/o2/token");
-		(*http)("POST", a_query)(v_scheduler->f_io(), [this, a_done, http](auto a_socket)
+		auto http = std::make_shared<t_http10>("https://api.amazon.com/auth/o2/token", &v_http);
+		(*http)("POST", a_query).f_fetch(v_scheduler->f_io(), []
 		{
-			boost::asio::async_read(*a_socket, http->v_buffer, v_scheduler->wrap([this, a_done, http, a_socket](auto a_ec, auto)
-			{
-				std::istream stream(&http->v_buffer);
-				picojson::value result;
-				stream >> result;
-				if (v_log) v_log(e_severity__TRACE) << "grant: " << http->v_http << ' ' << http->v_code << http->v_message << std::endl << result.serialize(true) << std::endl;
-				if (http->v_code == 200) {
-					auto access_token = result / "access_token"_jss;
-					size_t expires_in = result / "expires_in"_jsn;
-					auto refresh_token = result / "refresh_token"_jss;
-					std::ofstream("session/token") << refresh_token;
-					if (!v_session) this->f_create();
-					v_session->f_token(access_token);
-					v_scheduler->f_run_in(std::chrono::seconds(expires_in), [this, refresh_token](auto)
-					{
-						this->f_refresh(refresh_token);
-					});
-					a_done(boost::system::error_code());
-				} else {
-					a_done(boost::system::errc::make_error_code(boost::system::errc::protocol_error));
-				}
-			}));
-		}, v_scheduler->wrap([this, a_done](auto a_ec)
+			return true;
+		}, v_scheduler->wrap([this, a_done, http](auto a_ec)
 		{
-			if (v_log) v_log(e_severity__ERROR) << "grant: " << a_ec.message() << std::endl;
-			a_done(a_ec);
+			if (v_log) v_log(e_severity__TRACE) << "connections: " << v_http.f_connects() << " connects, " << v_http.f_handshakes() << " handshakes, " << v_http.f_reuses() << " reuses, " << v_http.f_retries() << " retries." << std::endl;
+			if (v_log) {
+				auto& tls = v_http.f_tls();
+				v_log(e_severity__TRACE) << "tls: " << tls.f_handshakes() << " handshakes, " << tls.f_resumptions() << " resumed, " << std::chrono::duration_cast<std::chrono::milliseconds>(tls.f_handshake_average()).count() << " ms average, " << std::chrono::duration_cast<std::chrono::milliseconds>(tls.f_handshake_max()).count() << " ms max." << std::endl;
+			}
+			if (a_ec) {
+				if (v_log) v_log(e_severity__ERROR) << "grant: " << a_ec.message() << std::endl;
+				return a_done(a_ec);
+			}
+			std::istringstream stream(http->v_body);
+			picojson::value result;
+			stream >> result;
+			if (v_log) v_log(e_severity__TRACE) << "grant: " << http->v_http << ' ' << http->v_code << http->v_message << std::endl << result.serialize(true) << std::endl;
+			if (http->v_code == 200) {
+				auto access_token = result / "access_token"_jss;
+				size_t expires_in = result / "expires_in"_jsn;
+				auto refresh_token = result / "refresh_token"_jss;
+				std::ofstream("session/token") << refresh_token;
+				if (!v_session) this->f_create();
+				v_session->f_token(access_token);
+				v_scheduler->f_run_in(std::chrono::seconds(expires_in), [this, refresh_token](auto)
+				{
+					this->f_refresh(refresh_token);
+				});
+				a_done(boost::system::error_code());
+			} else {
+				a_done(boost::system::errc::make_error_code(boost::system::errc::protocol_error));
+			}
 		}));
 	}
 	void f_refresh(const std::string& a_token)
@@ -256,10 +294,7 @@ public:
 		alcMakeContextCurrent(v_context);
 		alGetError();
 		alGenBuffers(4, v_sounds);
-		f_load_sound(v_sounds[0], a_sounds / "timer" / "foreground"_jss);
-		f_load_sound(v_sounds[1], a_sounds / "timer" / "background"_jss);
-		f_load_sound(v_sounds[2], a_sounds / "alarm" / "foreground"_jss);
-		f_load_sound(v_sounds[3], a_sounds / "alarm" / "background"_jss);
+		f_load_sounds(a_sounds);
 	}
 	~t_agent()
 	{
@@ -299,6 +334,7 @@ public:
 		v_scheduler->dispatch([this, a_done]
 		{
 			if (v_session) v_session->f_disconnect();
+			v_http.f_clear();
 			v_scheduler->f_shutdown(a_done);
 		});
 	}
@@ -0,0 +1,38 @@
+#ifndef ALEXAAGENT__ALLOCATION_H
+#define ALEXAAGENT__ALLOCATION_H
+
+#include <cstddef>
+
+// Counts what the replaced global operator new allocates on this thread; counts stay zero where it is not replaced, as in release builds.
+struct t_allocation_scope
+{
+	static t_allocation_scope*& f_current()
+	{
+		static thread_local t_allocation_scope* current = nullptr;
+		return current;
+	}
+	static void f_count(size_t a_n)
+	{
+		if (auto scope = f_current()) {
+			++scope->v_allocations;
+			scope->v_bytes += a_n;
+		}
+	}
+
+	size_t& v_allocations;
+	size_t& v_bytes;
+	t_allocation_scope* v_outer;
+
+	t_allocation_scope(size_t& a_allocations, size_t& a_bytes) : v_allocations(a_allocations), v_bytes(a_bytes), v_outer(f_current())
+	{
+		f_current() = this;
+	}
+	t_allocation_scope(const t_allocation_scope&) = delete;
+	~t_allocation_scope()
+	{
+		f_current() = v_outer;
+	}
+	t_allocation_scope& operator=(const t_allocation_scope&) = delete;
+};
+
+#endif
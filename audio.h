@@ -2,15 +2,56 @@
 #define ALEXAAGENT__AUDIO_H
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <functional>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <type_traits>
 #include <vector>
 #include <AL/al.h>
 #include <AL/alc.h>
 
+#include "sample.h"
+#include "spsc.h"
+
 extern "C"
 {
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
+#include <libavutil/channel_layout.h>
+#include <libswresample/swresample.h>
+}
+
+inline bool f_al_float32()
+{
+	return alIsExtensionPresent("AL_EXT_FLOAT32");
+}
+
+inline ALenum f_al_format(size_t a_channels, size_t a_bytes)
+{
+	switch (a_bytes) {
+	case 1:
+		return a_channels == 1 ? AL_FORMAT_MONO8 : AL_FORMAT_STEREO8;
+	case 2:
+		return a_channels == 1 ? AL_FORMAT_MONO16 : AL_FORMAT_STEREO16;
+	default:
+		{
+			static const ALenum mono = alGetEnumValue("AL_FORMAT_MONO_FLOAT32");
+			static const ALenum stereo = alGetEnumValue("AL_FORMAT_STEREO_FLOAT32");
+			return a_channels == 1 ? mono : stereo;
+		}
+	}
+}
+
+inline size_t f_al_frequency()
+{
+	ALCint rate = 0;
+	alcGetIntegerv(alcGetContextsDevice(alcGetCurrentContext()), ALC_FREQUENCY, 1, &rate);
+	return rate;
 }
 
 class t_audio_decoder;
@@ -19,68 +60,167 @@ class t_audio_source
 {
 	friend class t_audio_decoder;
 
+	static int f_interrupted(void* a_opaque)
+	{
+		auto p = static_cast<t_audio_source*>(a_opaque);
+		return p->v_interrupted.load(std::memory_order_relaxed) || (p->v_cancelled && p->v_cancelled->load(std::memory_order_relaxed));
+	}
+
+	std::atomic<bool> v_interrupted{false};
+	std::shared_ptr<const std::atomic<bool>> v_cancelled;
+
 protected:
 	AVFormatContext* v_format = nullptr;
 	int v_index = 0;
 	AVCodecContext* v_codec = nullptr;
 
+	// a_cancelled, if any, is raised by whoever is waiting for the source to abandon opening it.
+	void f_allocate(const std::shared_ptr<const std::atomic<bool>>& a_cancelled = {})
+	{
+		v_cancelled = a_cancelled;
+		v_format = avformat_alloc_context();
+		if (!v_format) throw std::runtime_error("avformat_alloc_context");
+		v_format->interrupt_callback.callback = f_interrupted;
+		v_format->interrupt_callback.opaque = this;
+	}
+	// Opens the decoder for the best audio stream of the already opened input.
+	void f_open_codec()
+	{
+		if (avformat_find_stream_info(v_format, NULL) < 0) throw std::runtime_error("avformat_find_stream_info");
+		AVCodec* decoder;
+		v_index = av_find_best_stream(v_format, AVMEDIA_TYPE_AUDIO, -1, -1, &decoder, 0);
+		if (v_index < 0) throw std::runtime_error("av_find_best_stream");
+		v_codec = avcodec_alloc_context3(decoder);
+		if (!v_codec) throw std::runtime_error("avcodec_alloc_context3");
+		if (avcodec_parameters_to_context(v_codec, v_format->streams[v_index]->codecpar) < 0) throw std::runtime_error("avcodec_parameters_to_context");
+		if (avcodec_open2(v_codec, decoder, NULL) < 0) throw std::runtime_error("avcodec_open2");
+	}
+
 public:
 	virtual ~t_audio_source()
 	{
 		avcodec_free_context(&v_codec);
 		avformat_close_input(&v_format);
 	}
+	// In seconds, or 0 when the input does not tell, as for live streams.
+	double f_duration() const
+	{
+		return v_format && v_format->duration != AV_NOPTS_VALUE ? static_cast<double>(v_format->duration) / AV_TIME_BASE : 0.0;
+	}
+	// Makes blocking reads from another thread give up as soon as possible.
+	void f_interrupt()
+	{
+		v_interrupted.store(true, std::memory_order_relaxed);
+	}
 };
 
-class t_audio_decoder
+// Downmixes to at most two channels and resamples to a fixed rate once, on the decoding side.
+class t_audio_converter
 {
-	AVFormatContext* v_format;
-	int v_index;
-	AVCodecContext* v_codec;
-	AVFrame* v_frame = nullptr;
-	AVPacket v_packet;
+	size_t v_rate;
+	bool v_float32;
+	SwrContext* v_swr = nullptr;
+	int v_input_format;
+	int64_t v_input_layout;
+	int v_input_rate;
+	size_t v_channels;
+	std::vector<char> v_buffer;
 
-	template<typename T_0, typename T_1>
-	T_0 f_convert(T_1 a_x)
+	template<typename T_target>
+	void f_convert(const uint8_t** a_data, int a_n, T_target a_target)
 	{
-		return a_x;
+		size_t bytes = v_float32 ? sizeof(float) : sizeof(int16_t);
+		int n = av_rescale_rnd(swr_get_delay(v_swr, v_input_rate) + a_n, v_rate, v_input_rate, AV_ROUND_UP);
+		if (v_buffer.size() < n * v_channels * bytes) v_buffer.resize(n * v_channels * bytes);
+		auto p = reinterpret_cast<uint8_t*>(v_buffer.data());
+		n = swr_convert(v_swr, &p, n, a_data, a_n);
+		if (n < 0) throw std::runtime_error("swr_convert: " + std::to_string(n));
+		if (n > 0) a_target(v_channels, bytes, v_buffer.data(), n * v_channels * bytes, v_rate);
 	}
-	template<typename T_0>
-	T_0 f_convert(int32_t a_x)
+
+public:
+	t_audio_converter(size_t a_rate, bool a_float32) : v_rate(a_rate), v_float32(a_float32)
 	{
-		return a_x >> 16;
 	}
-	template<typename T_0>
-	T_0 f_convert(float a_x)
+	~t_audio_converter()
 	{
-		return ~(~0 << sizeof(T_0) * 8 - 1) * a_x;
+		swr_free(&v_swr);
 	}
-	template<typename T_0>
-	T_0 f_convert(double a_x)
+	template<typename T_target>
+	void operator()(const AVFrame* a_frame, T_target a_target)
 	{
-		return ~(~0 << sizeof(T_0) * 8 - 1) * a_x;
+		int64_t layout = a_frame->channel_layout ? a_frame->channel_layout : av_get_default_channel_layout(a_frame->channels);
+		if (!v_swr || a_frame->format != v_input_format || layout != v_input_layout || a_frame->sample_rate != v_input_rate) {
+			f_flush(a_target);
+			swr_free(&v_swr);
+			v_input_format = a_frame->format;
+			v_input_layout = layout;
+			v_input_rate = a_frame->sample_rate;
+			v_channels = a_frame->channels > 1 ? 2 : 1;
+			v_swr = swr_alloc_set_opts(NULL, v_channels > 1 ? AV_CH_LAYOUT_STEREO : AV_CH_LAYOUT_MONO, v_float32 ? AV_SAMPLE_FMT_FLT : AV_SAMPLE_FMT_S16, v_rate, layout, static_cast<AVSampleFormat>(v_input_format), v_input_rate, 0, NULL);
+			if (!v_swr) throw std::runtime_error("swr_alloc_set_opts");
+			if (swr_init(v_swr) < 0) throw std::runtime_error("swr_init");
+		}
+		f_convert(const_cast<const uint8_t**>(a_frame->extended_data), a_frame->nb_samples, a_target);
 	}
-	uint8_t* f_at(nullptr_t, int a_bytes, int a_sample, int a_channel)
+	template<typename T_target>
+	void f_flush(T_target a_target)
 	{
-		return v_frame->data[0] + a_bytes * (v_frame->channels * a_sample + a_channel);
+		if (v_swr) f_convert(NULL, 0, a_target);
 	}
-	uint8_t* f_at(bool, int a_bytes, int a_sample, int a_channel)
+};
+
+class t_audio_decoder
+{
+	AVFormatContext* v_format;
+	int v_index;
+	AVCodecContext* v_codec;
+	AVFrame* v_frame = nullptr;
+	AVPacket v_packet;
+
+	const t_sample_kernels& v_kernels = t_sample_kernels::f_instance();
+	std::vector<char> v_buffer;
+	bool v_float32;
+	std::unique_ptr<t_audio_converter> v_converter;
+
+	template<typename T>
+	T* f_buffer(size_t a_n)
 	{
-		return v_frame->data[a_channel] + a_bytes * a_sample;
+		if (v_buffer.size() < a_n * sizeof(T)) v_buffer.resize(a_n * sizeof(T));
+		return reinterpret_cast<T*>(v_buffer.data());
 	}
-	template<typename T_0, typename T_1, typename T_planer, typename T_target>
-	void f_write(int a_channels, T_planer a_planer, T_target a_target)
+	template<typename T_0, typename T_1, typename T_target>
+	void f_write(int a_channels, bool a_planar, T_target a_target)
 	{
-		std::vector<char> data(v_frame->nb_samples * a_channels * sizeof(T_0));
-		int bytes = av_get_bytes_per_sample(v_codec->sample_fmt);
-		auto p = data.begin();
-		for (int i = 0; i < v_frame->nb_samples; ++i) {
-			for (int j = 0; j < a_channels; ++j) {
-				auto x = f_convert<T_0>(*reinterpret_cast<T_1*>(f_at(a_planer, bytes, i, j)));
-				p = std::copy_n(reinterpret_cast<char*>(&x), sizeof(T_0), p);
-			}
+		size_t samples = v_frame->nb_samples;
+		size_t n = samples * a_channels;
+		auto p = reinterpret_cast<const T_1*>(v_frame->data[0]);
+		const T_0* q;
+		if (a_planar && a_channels > 1) {
+			auto planes = reinterpret_cast<const T_1* const*>(v_frame->extended_data);
+			auto buffer = f_buffer<T_0>(n);
+			v_kernels(planes[0], planes[1], samples, buffer);
+			q = buffer;
+		} else if (!a_planar && a_channels < v_frame->channels) {
+			auto buffer = f_buffer<T_0>(n);
+			f_sample_pick(p, v_frame->channels, a_channels, samples, buffer);
+			q = buffer;
+		} else if (std::is_same<T_0, T_1>::value) {
+			q = reinterpret_cast<const T_0*>(p);
+		} else {
+			auto buffer = f_buffer<T_0>(n);
+			v_kernels(p, n, buffer);
+			q = buffer;
 		}
-		a_target(a_channels, sizeof(T_0), data.data(), data.size(), v_codec->sample_rate);
+		a_target(a_channels, sizeof(T_0), reinterpret_cast<const char*>(q), n * sizeof(T_0), v_codec->sample_rate);
+	}
+	template<typename T_1, typename T_target>
+	void f_write_float(int a_channels, bool a_planar, T_target a_target)
+	{
+		if (v_float32)
+			f_write<float, T_1>(a_channels, a_planar, a_target);
+		else
+			f_write<int16_t, T_1>(a_channels, a_planar, a_target);
 	}
 	template<typename T_target>
 	void f_decode(T_target a_target, const AVPacket* a_packet)
@@ -100,25 +240,27 @@ class t_audio_decoder
 			}
 			int channels = v_codec->channels;
 			if (channels < 1) throw std::runtime_error("no channels");
-			if (channels > 2) {
-				std::fprintf(stderr, "too many channels: %d\n", channels);
-				channels = 2;
+			if (v_converter) {
+				(*v_converter)(v_frame, a_target);
+				continue;
 			}
+			// Without the converter, more channels are reduced to the first two by f_write.
+			if (channels > 2) channels = 2;
 			switch (v_codec->sample_fmt) {
 			case AV_SAMPLE_FMT_U8:
-				f_write<char, char>(channels, nullptr, a_target);
+				f_write<char, char>(channels, false, a_target);
 				break;
 			case AV_SAMPLE_FMT_S16:
-				f_write<int16_t, int16_t>(channels, nullptr, a_target);
+				f_write<int16_t, int16_t>(channels, false, a_target);
 				break;
 			case AV_SAMPLE_FMT_S32:
-				f_write<int16_t, int32_t>(channels, nullptr, a_target);
+				f_write<int16_t, int32_t>(channels, false, a_target);
 				break;
 			case AV_SAMPLE_FMT_FLT:
-				f_write<int16_t, float>(channels, nullptr, a_target);
+				f_write_float<float>(channels, false, a_target);
 				break;
 			case AV_SAMPLE_FMT_DBL:
-				f_write<int16_t, double>(channels, nullptr, a_target);
+				f_write<int16_t, double>(channels, false, a_target);
 				break;
 			case AV_SAMPLE_FMT_U8P:
 				f_write<char, char>(channels, true, a_target);
@@ -130,7 +272,7 @@ class t_audio_decoder
 				f_write<int16_t, int32_t>(channels, true, a_target);
 				break;
 			case AV_SAMPLE_FMT_FLTP:
-				f_write<int16_t, float>(channels, true, a_target);
+				f_write_float<float>(channels, true, a_target);
 				break;
 			case AV_SAMPLE_FMT_DBLP:
 				f_write<int16_t, double>(channels, true, a_target);
@@ -142,8 +284,9 @@ class t_audio_decoder
 	}
 
 public:
-	t_audio_decoder(t_audio_source& a_source) : v_format(a_source.v_format), v_index(a_source.v_index), v_codec(a_source.v_codec)
+	t_audio_decoder(t_audio_source& a_source, bool a_float32 = false, size_t a_rate = 0) : v_format(a_source.v_format), v_index(a_source.v_index), v_codec(a_source.v_codec), v_float32(a_float32)
 	{
+		if (a_rate > 0) v_converter.reset(new t_audio_converter(a_rate, a_float32));
 		v_frame = av_frame_alloc();
 		if (!v_frame) throw std::runtime_error("av_frame_alloc");
 		av_init_packet(&v_packet);
@@ -163,81 +306,243 @@ public:
 			av_packet_unref(&v_packet);
 		}
 		f_decode(a_target, NULL);
+		if (v_converter) v_converter->f_flush(a_target);
+	}
+};
+
+// Decodes a source on a worker thread, a_blocks decoded blocks ahead of the consumer.
+// The worker blocks while the ring is full until f_pop, and calls a_ready on its own thread to wake a consumer armed by f_arm.
+// Destroying it interrupts the source and joins the worker.
+class t_audio_decode_ahead
+{
+public:
+	struct t_block
+	{
+		size_t v_channels;
+		size_t v_bytes;
+		size_t v_rate;
+		std::vector<char> v_data;
+	};
+
+private:
+	struct t_stopped
+	{
+	};
+
+	t_audio_source& v_source;
+	t_spsc_ring<t_block> v_blocks;
+	std::function<void()> v_ready;
+	std::mutex v_mutex;
+	std::condition_variable v_popped;
+	std::atomic<bool> v_armed{false};
+	std::atomic<bool> v_stopping{false};
+	std::atomic<bool> v_done{false};
+	std::exception_ptr v_error;
+	std::thread v_thread;
+
+	void f_signal()
+	{
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (v_armed.exchange(false)) v_ready();
+	}
+
+public:
+	t_audio_decode_ahead(t_audio_source& a_source, size_t a_blocks, std::function<void()>&& a_ready, bool a_float32 = false, size_t a_rate = 0) : v_source(a_source), v_blocks(a_blocks), v_ready(std::move(a_ready))
+	{
+		v_thread = std::thread([this, a_float32, a_rate]
+		{
+			try {
+				t_audio_decoder decoder(v_source, a_float32, a_rate);
+				decoder([this](size_t a_channels, size_t a_bytes, const char* a_p, size_t a_n, size_t a_rate)
+				{
+					t_block* block = v_blocks.f_back();
+					if (!block) {
+						std::unique_lock<std::mutex> lock(v_mutex);
+						v_popped.wait(lock, [&]
+						{
+							return v_stopping || (block = v_blocks.f_back());
+						});
+					}
+					if (v_stopping) throw t_stopped();
+					block->v_channels = a_channels;
+					block->v_bytes = a_bytes;
+					block->v_rate = a_rate;
+					block->v_data.assign(a_p, a_p + a_n);
+					v_blocks.f_push();
+					f_signal();
+				});
+			} catch (t_stopped) {
+			} catch (...) {
+				v_error = std::current_exception();
+			}
+			v_done.store(true, std::memory_order_release);
+			f_signal();
+		});
+	}
+	~t_audio_decode_ahead()
+	{
+		{
+			std::lock_guard<std::mutex> lock(v_mutex);
+			v_stopping = true;
+		}
+		v_popped.notify_one();
+		v_source.f_interrupt();
+		v_thread.join();
+	}
+	t_block* f_front()
+	{
+		return v_blocks.f_front();
+	}
+	void f_pop()
+	{
+		v_blocks.f_pop();
+		// Taking the lock orders the pop against a worker about to wait, so the notification cannot be lost.
+		{
+			std::lock_guard<std::mutex> lock(v_mutex);
+		}
+		v_popped.notify_one();
+	}
+	// Asks for a_ready on the next block or the end; false if either is already there and the consumer should not wait.
+	bool f_arm()
+	{
+		v_armed.store(true);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (!v_blocks.f_front() && !v_done.load(std::memory_order_acquire)) return true;
+		v_armed.store(false);
+		return false;
+	}
+	// True once every block has been consumed; rethrows what stopped the worker, if anything.
+	bool f_finished()
+	{
+		if (!v_done.load(std::memory_order_acquire) || v_blocks.f_front()) return false;
+		if (v_error) std::rethrow_exception(v_error);
+		return true;
 	}
 };
 
 struct t_url_audio_source : t_audio_source
 {
-	t_url_audio_source(const char* a_url)
+	t_url_audio_source(const char* a_url, const std::shared_ptr<const std::atomic<bool>>& a_cancelled = {})
 	{
+		f_allocate(a_cancelled);
 		int n = avformat_open_input(&v_format, a_url, NULL, NULL);
 		if (n < 0) throw std::runtime_error("avformat_open_input");
-		if (avformat_find_stream_info(v_format, NULL) < 0) throw std::runtime_error("avformat_find_stream_info");
-		AVCodec* decoder;
-		v_index = av_find_best_stream(v_format, AVMEDIA_TYPE_AUDIO, -1, -1, &decoder, 0);
-		if (v_index < 0) throw std::runtime_error("av_find_best_stream");
-		v_codec = avcodec_alloc_context3(decoder);
-		if (!v_codec) throw std::runtime_error("avcodec_alloc_context3");
-		if (avcodec_parameters_to_context(v_codec, v_format->streams[v_index]->codecpar) < 0) throw std::runtime_error("avcodec_parameters_to_context");
-		if (avcodec_open2(v_codec, decoder, NULL) < 0) throw std::runtime_error("avcodec_open2");
+		f_open_codec();
 	}
 };
 
+// Reads through a_read into an AVIO buffer of a_buffer bytes and probes the format from what it reads.
+// The probe is kept short, since every read may have to wait for the stream to arrive.
 class t_callback_audio_source : public t_audio_source
 {
 	static int f_read(void* a_opaque, uint8_t* a_p, int a_n)
 	{
-		return static_cast<t_callback_audio_source*>(a_opaque)->v_read(a_p, a_n);
+		auto p = static_cast<t_callback_audio_source*>(a_opaque);
+		int n = p->v_read(a_p, a_n);
+		++p->v_reads;
+		if (n > 0) p->v_bytes += n;
+		return n;
 	}
 
 	std::function<int(uint8_t*, int)> v_read;
 	AVIOContext* v_io = nullptr;
+	size_t v_reads = 0;
+	size_t v_bytes = 0;
+
+	void f_close()
+	{
+		avcodec_free_context(&v_codec);
+		avformat_close_input(&v_format);
+		av_freep(&v_io->buffer);
+		av_free(v_io);
+	}
 
 public:
-	t_callback_audio_source(std::function<int(uint8_t*, int)>&& a_read) : v_read(std::move(a_read))
+	t_callback_audio_source(std::function<int(uint8_t*, int)>&& a_read, size_t a_buffer = 32768, const std::shared_ptr<const std::atomic<bool>>& a_cancelled = {}) : v_read(std::move(a_read))
 	{
-		v_format = avformat_alloc_context();
-		if (!v_format) throw std::runtime_error("avformat_alloc_context");
-		const size_t v_size = 4096;
-		auto buffer = static_cast<uint8_t*>(av_malloc(v_size));
+		f_allocate(a_cancelled);
+		auto buffer = static_cast<uint8_t*>(av_malloc(a_buffer));
 		if (buffer == NULL) throw std::runtime_error("av_malloc");
-		v_io = avio_alloc_context(buffer, v_size, 0, this, f_read, NULL, NULL);
-		if (!v_io) throw std::runtime_error("avio_alloc_context");
-		v_format->pb = v_io;
-		int n = avformat_open_input(&v_format, NULL, NULL, NULL);
-		if (n < 0) throw std::runtime_error("avformat_open_input");
-		auto decoder = avcodec_find_decoder(AV_CODEC_ID_MP3);
-		if (!decoder) throw std::runtime_error("avcodec_find_decoder");
-		v_codec = avcodec_alloc_context3(decoder);
-		if (!v_codec) throw std::runtime_error("avcodec_alloc_context3");
-		if (avcodec_open2(v_codec, decoder, NULL) < 0) throw std::runtime_error("avcodec_open2");
+		v_io = avio_alloc_context(buffer, a_buffer, 0, this, f_read, NULL, NULL);
+		if (!v_io) {
+			av_free(buffer);
+			throw std::runtime_error("avio_alloc_context");
+		}
+		// This destructor does not run if the constructor throws, so v_io is released here until it completes.
+		try {
+			v_format->pb = v_io;
+			v_format->flags |= AVFMT_FLAG_CUSTOM_IO;
+			v_format->probesize = std::max<size_t>(a_buffer, 4096);
+			v_format->max_analyze_duration = AV_TIME_BASE / 2;
+			int n = avformat_open_input(&v_format, NULL, NULL, NULL);
+			if (n < 0) throw std::runtime_error("avformat_open_input");
+			f_open_codec();
+		} catch (...) {
+			f_close();
+			throw;
+		}
 	}
 	virtual ~t_callback_audio_source()
 	{
-		av_freep(&v_io->buffer);
-		av_free(v_io);
+		f_close();
+	}
+	size_t f_reads() const
+	{
+		return v_reads;
+	}
+	size_t f_bytes() const
+	{
+		return v_bytes;
+	}
+	double f_bytes_per_read() const
+	{
+		return v_reads > 0 ? static_cast<double>(v_bytes) / v_reads : 0.0;
 	}
 };
 
+// Opens an in-memory manifest, such as an HLS playlist, letting ffmpeg fetch what it refers to.
+inline t_audio_source* f_manifest_audio_source(const std::string& a_manifest, const std::shared_ptr<const std::atomic<bool>>& a_cancelled = {})
+{
+	auto buffer = std::make_shared<std::stringbuf>(a_manifest);
+	return new t_callback_audio_source([buffer](auto a_p, auto a_n)
+	{
+		return buffer->sgetn(reinterpret_cast<char*>(a_p), a_n);
+	}, 32768, a_cancelled);
+}
+
+// Plays through a fixed pool of AL buffers, refilled in rotation as they are processed.
+// Decoded frames are gathered into chunks of at least a_chunk seconds before being queued.
+// Queued durations are tracked locally, so positions never query the buffers back from OpenAL.
+// The pool holds a_latency seconds of such chunks, or of the shortest codec frames (20 ms) in common use.
 class t_audio_target
 {
-	static double f_duration(ALuint a_buffer)
+	struct t_queued
 	{
-		ALint channels;
-		alGetBufferi(a_buffer, AL_CHANNELS, &channels);
-		ALint bits;
-		alGetBufferi(a_buffer, AL_BITS, &bits);
-		ALint size;
-		alGetBufferi(a_buffer, AL_SIZE, &size);
-		ALint frequency;
-		alGetBufferi(a_buffer, AL_FREQUENCY, &frequency);
-		return size * 8.0 / (channels * bits * frequency);
-	}
+		size_t v_samples;
+		size_t v_rate;
+
+		double f_duration() const
+		{
+			return static_cast<double>(v_samples) / v_rate;
+		}
+	};
 
 	ALuint v_source;
+	double v_latency;
+	double v_chunk;
+	std::vector<ALuint> v_buffers;
+	std::vector<ALuint> v_free;
+	std::vector<t_queued> v_queued;
+	size_t v_head = 0;
+	size_t v_n = 0;
+	size_t v_unqueued = 0;
+	std::vector<char> v_pending;
+	size_t v_channels = 0;
+	size_t v_bytes = 0;
+	size_t v_rate = 0;
 	double v_remain = 0.0;
 	double v_processed = 0.0;
-	ALfloat v_offset = 0.0;
+	double v_offset = 0.0;
 
 	ALint f_get(ALenum a_name) const
 	{
@@ -245,25 +550,68 @@ class t_audio_target
 		alGetSourcei(v_source, a_name, &i);
 		return i;
 	}
-	void f_unqueue(ALuint* a_p, size_t a_n)
+	void f_unqueue(size_t a_n)
 	{
-		alSourceUnqueueBuffers(v_source, a_n, a_p);
+		size_t m = v_free.size();
+		v_free.resize(m + a_n);
+		alSourceUnqueueBuffers(v_source, a_n, v_free.data() + m);
 		for (size_t i = 0; i < a_n; ++i) {
-			double x = f_duration(a_p[i]);
+			double x = v_queued[v_head].f_duration();
 			v_remain -= x;
 			v_processed += x;
+			if (++v_head >= v_queued.size()) v_head = 0;
 		}
+		v_n -= a_n;
+		v_unqueued += a_n;
+	}
+	void f_update()
+	{
+		ALint samples;
+		alGetSourcei(v_source, AL_SAMPLE_OFFSET, &samples);
+		v_offset = 0.0;
+		for (size_t i = 0, j = v_head; i < v_n; ++i) {
+			auto& x = v_queued[j];
+			if (static_cast<size_t>(samples) < x.v_samples) {
+				v_offset += static_cast<double>(samples) / x.v_rate;
+				break;
+			}
+			v_offset += x.f_duration();
+			samples -= x.v_samples;
+			if (++j >= v_queued.size()) j = 0;
+		}
+	}
+	ALint f_queue(size_t a_channels, size_t a_bytes, const char* a_p, size_t a_n, size_t a_rate)
+	{
+		// Unqueue on every call, or a source that has run dry would replay what it already played once restarted.
+		f_unqueue(f_get(AL_BUFFERS_PROCESSED));
+		if (v_free.empty()) throw std::runtime_error("no free buffer");
+		ALuint buffer = v_free.back();
+		v_free.pop_back();
+		alBufferData(buffer, f_al_format(a_channels, a_bytes), a_p, a_n, a_rate);
+		alSourceQueueBuffers(v_source, 1, &buffer);
+		t_queued x{a_n / (a_channels * a_bytes), a_rate};
+		v_queued[(v_head + v_n++) % v_queued.size()] = x;
+		v_remain += x.f_duration();
+		ALint state = f_get(AL_SOURCE_STATE);
+		if (state != AL_PLAYING) alSourcePlay(v_source);
+		f_update();
+		return v_buffers.size() - v_free.size();
 	}
 
 public:
-	t_audio_target()
+	t_audio_target(double a_latency = 1.0, double a_chunk = 0.0) : v_latency(a_latency), v_chunk(a_chunk), v_buffers(static_cast<size_t>(a_latency / std::max(a_chunk, 0.02)) + 2)
 	{
 		alGenSources(1, &v_source);
+		alGenBuffers(v_buffers.size(), v_buffers.data());
+		v_free.reserve(v_buffers.size());
+		v_free.assign(v_buffers.rbegin(), v_buffers.rend());
+		v_queued.resize(v_buffers.size());
 	}
 	~t_audio_target()
 	{
 		f_stop();
 		alDeleteSources(1, &v_source);
+		alDeleteBuffers(v_buffers.size(), v_buffers.data());
 	}
 	operator ALuint() const
 	{
@@ -271,56 +619,72 @@ public:
 	}
 	double f_remain() const
 	{
-		return v_remain;
+		return v_remain - v_offset;
 	}
 	double f_offset() const
 	{
 		return v_processed + v_offset;
 	}
+	// Buffers ever queued and ever unqueued, which count exactly where summed durations may be off by a rounding error.
+	size_t f_buffers_queued() const
+	{
+		return v_unqueued + v_n;
+	}
+	size_t f_buffers_played() const
+	{
+		return v_unqueued;
+	}
 	void f_reset()
 	{
 		v_remain = v_processed = v_offset = 0.0;
 	}
+	bool f_full() const
+	{
+		return v_free.empty() || f_remain() >= v_latency;
+	}
 	ALint operator()(size_t a_channels, size_t a_bytes, const char* a_p, size_t a_n, size_t a_rate)
 	{
-		ALint queued = f_get(AL_BUFFERS_QUEUED);
-		ALint n = f_get(AL_BUFFERS_PROCESSED);
-		ALuint buffer;
-		if (n > 1) {
-			std::vector<ALuint> buffers(n);
-			f_unqueue(buffers.data(), n);
-			alDeleteBuffers(--n, buffers.data());
-			buffer = buffers.back();
-		} if (n > 0) {
-			f_unqueue(&buffer, 1);
-		} else {
-			alGenBuffers(1, &buffer);
+		if (v_pending.empty()) {
+			if (a_n >= static_cast<size_t>(v_chunk * a_rate) * a_channels * a_bytes) return f_queue(a_channels, a_bytes, a_p, a_n, a_rate);
+		} else if (a_channels != v_channels || a_bytes != v_bytes || a_rate != v_rate) {
+			auto queued = f_queue(v_channels, v_bytes, v_pending.data(), v_pending.size(), v_rate);
+			v_pending.assign(a_p, a_p + a_n);
+			v_channels = a_channels;
+			v_bytes = a_bytes;
+			v_rate = a_rate;
+			return queued;
 		}
-		alBufferData(buffer, a_channels == 1 ? (a_bytes == 1 ? AL_FORMAT_MONO8 : AL_FORMAT_MONO16) : (a_bytes == 1 ? AL_FORMAT_STEREO8 : AL_FORMAT_STEREO16), a_p, a_n, a_rate);
-		alSourceQueueBuffers(v_source, 1, &buffer);
-		v_remain += f_duration(buffer);
-		ALint state = f_get(AL_SOURCE_STATE);
-		if (state != AL_PLAYING) alSourcePlay(v_source);
-		alGetSourcef(v_source, AL_SEC_OFFSET, &v_offset);
-		return ++queued - n;
+		v_pending.insert(v_pending.end(), a_p, a_p + a_n);
+		v_channels = a_channels;
+		v_bytes = a_bytes;
+		v_rate = a_rate;
+		if (v_pending.size() < static_cast<size_t>(v_chunk * a_rate) * a_channels * a_bytes) return v_buffers.size() - v_free.size();
+		auto queued = f_queue(a_channels, a_bytes, v_pending.data(), v_pending.size(), a_rate);
+		v_pending.clear();
+		return queued;
+	}
+	// Queues what is left of the last chunk at the end of a stream.
+	void f_end()
+	{
+		if (v_pending.empty()) return;
+		f_queue(v_channels, v_bytes, v_pending.data(), v_pending.size(), v_rate);
+		v_pending.clear();
 	}
 	ALint f_flush()
 	{
-		ALint queued = f_get(AL_BUFFERS_QUEUED);
-		ALint n = f_get(AL_BUFFERS_PROCESSED);
-		std::vector<ALuint> buffers(n);
-		f_unqueue(buffers.data(), n);
-		alDeleteBuffers(n, buffers.data());
-		alGetSourcef(v_source, AL_SEC_OFFSET, &v_offset);
-		return queued - n;
+		f_unqueue(f_get(AL_BUFFERS_PROCESSED));
+		f_update();
+		return v_buffers.size() - v_free.size();
 	}
 	void f_stop()
 	{
 		alSourceStop(v_source);
-		ALint n = f_get(AL_BUFFERS_QUEUED);
-		std::vector<ALuint> buffers(n);
-		alSourceUnqueueBuffers(v_source, n, buffers.data());
-		alDeleteBuffers(n, buffers.data());
+		v_pending.clear();
+		size_t m = v_free.size();
+		v_free.resize(v_buffers.size());
+		alSourceUnqueueBuffers(v_source, v_free.size() - m, v_free.data() + m);
+		v_unqueued += v_n;
+		v_head = v_n = 0;
 		f_reset();
 	}
 };
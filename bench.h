@@ -0,0 +1,36 @@
+#ifndef ALEXAAGENT__BENCH_H
+#define ALEXAAGENT__BENCH_H
+
+#include <chrono>
+#include <cstdio>
+
+#include "counting_new.h"
+
+struct t_bench
+{
+	double v_seconds = 0.0;
+	size_t v_allocations = 0;
+	size_t v_bytes = 0;
+	// The sum of what the runs returned, which keeps their work from being optimized away.
+	size_t v_result = 0;
+};
+
+// Calls a_run(i) for i in [0, a_repeat), timing the calls and counting what they allocate.
+template<typename T_run>
+t_bench f_bench(size_t a_repeat, T_run a_run)
+{
+	t_bench bench;
+	t_allocation_scope scope(bench.v_allocations, bench.v_bytes);
+	auto t0 = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < a_repeat; ++i) bench.v_result += a_run(i);
+	bench.v_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+	return bench;
+}
+
+// Prints the time and allocations per each of a_n a_units.
+inline void f_report(const char* a_name, const char* a_unit, size_t a_n, const t_bench& a_bench)
+{
+	std::fprintf(stderr, "%s: %.1f ns/%s, %.2f allocations/%s (%zu)\n", a_name, a_bench.v_seconds * 1e9 / a_n, a_unit, static_cast<double>(a_bench.v_allocations) / a_n, a_unit, a_bench.v_result);
+}
+
+#endif
@@ -0,0 +1,90 @@
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <AL/alext.h>
+
+#include "audio.h"
+
+// Renders the OpenAL mixer on this thread through a loopback device, so the time spent in
+// alcRenderSamplesSOFT is the mixer-thread cost of playing what the decoder produced.
+struct t_loopback
+{
+	LPALCRENDERSAMPLESSOFT v_render;
+	ALCdevice* v_device;
+	ALCcontext* v_context;
+	size_t v_rate;
+	int16_t v_samples[1024 * 2];
+	std::chrono::steady_clock::duration v_mixing{};
+	size_t v_frames = 0;
+
+	t_loopback(size_t a_rate) : v_rate(a_rate)
+	{
+		if (!alcIsExtensionPresent(NULL, "ALC_SOFT_loopback")) throw std::runtime_error("ALC_SOFT_loopback");
+		auto open = reinterpret_cast<LPALCLOOPBACKOPENDEVICESOFT>(alcGetProcAddress(NULL, "alcLoopbackOpenDeviceSOFT"));
+		v_render = reinterpret_cast<LPALCRENDERSAMPLESSOFT>(alcGetProcAddress(NULL, "alcRenderSamplesSOFT"));
+		v_device = open(NULL);
+		if (!v_device) throw std::runtime_error("alcLoopbackOpenDeviceSOFT");
+		ALCint attributes[] = {
+			ALC_FORMAT_CHANNELS_SOFT, ALC_STEREO_SOFT,
+			ALC_FORMAT_TYPE_SOFT, ALC_SHORT_SOFT,
+			ALC_FREQUENCY, static_cast<ALCint>(a_rate),
+			0
+		};
+		v_context = alcCreateContext(v_device, attributes);
+		if (!v_context) throw std::runtime_error("alcCreateContext");
+		alcMakeContextCurrent(v_context);
+	}
+	~t_loopback()
+	{
+		alcMakeContextCurrent(NULL);
+		alcDestroyContext(v_context);
+		alcCloseDevice(v_device);
+	}
+	void operator()()
+	{
+		auto t0 = std::chrono::steady_clock::now();
+		v_render(v_device, v_samples, 1024);
+		v_mixing += std::chrono::steady_clock::now() - t0;
+		v_frames += 1024;
+	}
+};
+
+void f_measure(const char* a_path, size_t a_rate, bool a_convert)
+{
+	t_loopback loopback(a_rate);
+	t_url_audio_source source(a_path);
+	t_audio_decoder decoder(source, false, a_convert ? f_al_frequency() : 0);
+	size_t frames = 0;
+	auto t0 = std::chrono::steady_clock::now();
+	{
+		t_audio_target target(0.2, 0.04);
+		decoder([&](size_t a_channels, size_t a_bytes, const char* a_p, size_t a_n, size_t a_rate)
+		{
+			++frames;
+			target(a_channels, a_bytes, a_p, a_n, a_rate);
+			while (target.f_full()) {
+				loopback();
+				target.f_flush();
+			}
+		});
+		target.f_end();
+		while (target.f_flush() > 0) loopback();
+	}
+	auto total = std::chrono::steady_clock::now() - t0;
+	auto mixing = std::chrono::duration<double, std::milli>(loopback.v_mixing).count();
+	double played = static_cast<double>(loopback.v_frames) / a_rate;
+	std::fprintf(stderr, "%s: %zu frames, %.1f s played, mixer %.1f ms (%.3f%%), decoder %.1f ms\n", a_convert ? "converted" : "native", frames, played, mixing, mixing / played / 10.0, std::chrono::duration<double, std::milli>(total).count() - mixing);
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 2) {
+		std::fprintf(stderr, "usage: %s file [rate]\n", argv[0]);
+		return -1;
+	}
+	size_t rate = argc > 2 ? std::atoi(argv[2]) : 48000;
+	av_register_all();
+	f_measure(argv[1], rate, false);
+	f_measure(argv[1], rate, true);
+	return 0;
+}
@@ -0,0 +1,141 @@
+#include "bench.h"
+#include "json.h"
+
+const std::string v_boundary_metadata =
+	"--this-is-a-boundary\r\n"
+	"Content-Disposition: form-data; name=\"metadata\"\r\n"
+	"Content-Type: application/json; charset=UTF-8\r\n\r\n";
+const std::string v_boundary_terminator = "\r\n--this-is-a-boundary--\r\n";
+const std::string v_token = "amzn1.as-ct.v1.Domain:Application:Music#ACRI#url#ACRI#ContentToken.0123456789abcdef";
+size_t v_message_id = 0;
+
+picojson::value f_tree(const std::string& a_namespace, const std::string& a_name, picojson::value::object&& a_payload)
+{
+	return picojson::value(picojson::value::object{
+		{"event", picojson::value(picojson::value::object{
+			{"header", picojson::value(picojson::value::object{
+				{"namespace", picojson::value(a_namespace)},
+				{"name", picojson::value(a_name)},
+				{"messageId", picojson::value("messateId-" + std::to_string(++v_message_id))}
+			})},
+			{"payload", picojson::value(std::move(a_payload))}
+		})}
+	});
+}
+
+template<typename T_payload>
+void f_write(std::string& a_s, const std::string& a_namespace, const std::string& a_name, T_payload a_payload)
+{
+	t_json_writer writer(a_s);
+	writer.f_begin_object();
+	writer.f_key("event").f_begin_object();
+	writer.f_key("header").f_begin_object();
+	writer.f_key("namespace").f_value(a_namespace);
+	writer.f_key("name").f_value(a_name);
+	char id[32];
+	writer.f_key("messageId").f_value(id, std::sprintf(id, "messateId-%zu", ++v_message_id));
+	writer.f_end_object();
+	writer.f_key("payload").f_begin_object();
+	a_payload(writer);
+	writer.f_end_object();
+	writer.f_end_object();
+	writer.f_end_object();
+}
+
+template<typename T_event>
+void f_measure(const char* a_name, size_t a_repeat, T_event a_event)
+{
+	auto bench = f_bench(a_repeat, [&](size_t a_i)
+	{
+		return a_event(static_cast<long>(a_i));
+	});
+	std::fprintf(stderr, "%s: %.1f ns/event, %.2f allocations/event, %.1f bytes/event\n", a_name, bench.v_seconds * 1e9 / a_repeat, static_cast<double>(bench.v_allocations) / a_repeat, static_cast<double>(bench.v_result) / a_repeat);
+}
+
+int main(int argc, char* argv[])
+{
+	const size_t repeat = 200000;
+	f_measure("picojson: AudioPlayer.ProgressReportIntervalElapsed", repeat, [](long a_i)
+	{
+		return (v_boundary_metadata + f_tree("AudioPlayer", "ProgressReportIntervalElapsed", {
+			{"token", picojson::value(v_token)},
+			{"offsetInMilliseconds", picojson::value(static_cast<double>(a_i))}
+		}).serialize() + v_boundary_terminator).size();
+	});
+	{
+		std::string buffer;
+		f_measure("t_json_writer: AudioPlayer.ProgressReportIntervalElapsed", repeat, [&](long a_i)
+		{
+			buffer.clear();
+			buffer += v_boundary_metadata;
+			f_write(buffer, "AudioPlayer", "ProgressReportIntervalElapsed", [&](auto& a_writer)
+			{
+				a_writer.f_key("token").f_value(v_token);
+				a_writer.f_key("offsetInMilliseconds").f_value(a_i);
+			});
+			buffer += v_boundary_terminator;
+			return buffer.size();
+		});
+	}
+	f_measure("picojson: Speaker.VolumeChanged", repeat, [](long a_i)
+	{
+		return (v_boundary_metadata + f_tree("Speaker", "VolumeChanged", {
+			{"volume", picojson::value(static_cast<double>(a_i % 101))},
+			{"muted", picojson::value(false)}
+		}).serialize() + v_boundary_terminator).size();
+	});
+	{
+		std::string buffer;
+		f_measure("t_json_writer: Speaker.VolumeChanged", repeat, [&](long a_i)
+		{
+			buffer.clear();
+			buffer += v_boundary_metadata;
+			f_write(buffer, "Speaker", "VolumeChanged", [&](auto& a_writer)
+			{
+				a_writer.f_key("volume").f_value(a_i % 101);
+				a_writer.f_key("muted").f_value(false);
+			});
+			buffer += v_boundary_terminator;
+			return buffer.size();
+		});
+	}
+	f_measure("picojson: AudioPlayer.PlaybackFailed", repeat, [](long a_i)
+	{
+		return (v_boundary_metadata + f_tree("AudioPlayer", "PlaybackFailed", {
+			{"token", picojson::value(v_token)},
+			{"currentPlaybackState", picojson::value(picojson::value::object{
+				{"token", picojson::value(v_token)},
+				{"offsetInMilliseconds", picojson::value(static_cast<double>(a_i))},
+				{"playerActivity", picojson::value("PLAYING")}
+			})},
+			{"error", picojson::value(picojson::value::object{
+				{"type", picojson::value("MEDIA_ERROR_UNKNOWN")},
+				{"message", picojson::value("Connection reset by peer")}
+			})}
+		}).serialize() + v_boundary_terminator).size();
+	});
+	{
+		std::string buffer;
+		f_measure("t_json_writer: AudioPlayer.PlaybackFailed", repeat, [&](long a_i)
+		{
+			buffer.clear();
+			buffer += v_boundary_metadata;
+			f_write(buffer, "AudioPlayer", "PlaybackFailed", [&](auto& a_writer)
+			{
+				a_writer.f_key("token").f_value(v_token);
+				a_writer.f_key("currentPlaybackState").f_begin_object();
+				a_writer.f_key("token").f_value(v_token);
+				a_writer.f_key("offsetInMilliseconds").f_value(a_i);
+				a_writer.f_key("playerActivity").f_value("PLAYING");
+				a_writer.f_end_object();
+				a_writer.f_key("error").f_begin_object();
+				a_writer.f_key("type").f_value("MEDIA_ERROR_UNKNOWN");
+				a_writer.f_key("message").f_value("Connection reset by peer");
+				a_writer.f_end_object();
+			});
+			buffer += v_boundary_terminator;
+			return buffer.size();
+		});
+	}
+	return 0;
+}
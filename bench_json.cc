@@ -0,0 +1,90 @@
+#include "bench.h"
+#include "json.h"
+
+picojson::value f_parse(const std::string& a_json)
+{
+	picojson::value value;
+	std::string error;
+	picojson::parse(value, a_json.begin(), a_json.end(), &error);
+	if (!error.empty()) throw std::runtime_error(error);
+	return value;
+}
+
+template<typename T_access>
+void f_measure(const char* a_name, const std::vector<picojson::value>& a_directives, size_t a_repeat, T_access a_access)
+{
+	f_report(a_name, "directive", a_repeat * a_directives.size(), f_bench(a_repeat, [&](size_t)
+	{
+		size_t n = 0;
+		for (auto& x : a_directives) n += a_access(x);
+		return n;
+	}));
+}
+
+int main(int argc, char* argv[])
+{
+	std::vector<picojson::value> directives{
+		f_parse(R"({"directive":{"header":{"namespace":"Alerts","name":"SetAlert","messageId":"1"},"payload":{"token":"alert-token-0123456789","type":"TIMER","scheduledTime":"2016-09-01T12:34:56+0000"}}})"),
+		f_parse(R"({"directive":{"header":{"namespace":"AudioPlayer","name":"Play","messageId":"2","dialogRequestId":"dialogRequestId-1"},"payload":{"playBehavior":"REPLACE_ALL","audioItem":{"audioItemId":"item-0","stream":{"url":"https://example.com/stream.mp3","streamFormat":"AUDIO_MPEG","offsetInMilliseconds":0,"token":"stream-token-0123456789","progressReport":{"progressReportDelayInMilliseconds":5000,"progressReportIntervalInMilliseconds":10000}}}}}})"),
+		f_parse(R"({"directive":{"header":{"namespace":"SpeechRecognizer","name":"ExpectSpeech","messageId":"3","dialogRequestId":"dialogRequestId-2"},"payload":{"timeoutInMilliseconds":8000}}})"),
+		f_parse(R"({"directive":{"header":{"namespace":"Speaker","name":"SetVolume","messageId":"4"},"payload":{"volume":50}}})")
+	};
+	const size_t repeat = 100000;
+	f_measure("t_get/t_json_key", directives, repeat, [](const picojson::value& a_directive)
+	{
+		auto& header = a_directive / "directive" / "header";
+		auto& ns = header / "namespace"_jss;
+		auto& name = header / "name"_jss;
+		auto& payload = a_directive / "directive" / "payload";
+		size_t n = ns.size() + name.size() + (header * "dialogRequestId" | std::string()).size();
+		if (name == "SetAlert") {
+			n += (payload / "token"_jss).size() + (payload / "type"_jss).size() + (payload / "scheduledTime"_jss).size();
+		} else if (name == "Play") {
+			n += (payload / "playBehavior"_jss).size();
+			auto& stream = payload / "audioItem" / "stream";
+			n += (stream / "url"_jss).size() + (stream / "token"_jss).size();
+			auto report = stream * "progressReport";
+			if (!!report) n += static_cast<size_t>(((*report * "progressReportDelayInMilliseconds") | 0.0) + ((*report * "progressReportIntervalInMilliseconds") | 0.0));
+		} else if (name == "ExpectSpeech") {
+			n += static_cast<size_t>(payload / "timeoutInMilliseconds"_jsn);
+		} else {
+			n += static_cast<size_t>(payload / "volume"_jsn);
+		}
+		return n;
+	});
+	f_measure("std::string/std::map::at", directives, repeat, [](const picojson::value& a_directive)
+	{
+		auto at = [](const picojson::value& a_value, const std::string& a_name) -> const picojson::value&
+		{
+			return a_value.get<picojson::value::object>().at(a_name);
+		};
+		auto& header = at(at(a_directive, "directive"), "header");
+		auto& ns = at(header, "namespace").get<std::string>();
+		auto& name = at(header, "name").get<std::string>();
+		auto& payload = at(at(a_directive, "directive"), "payload");
+		auto& h = header.get<picojson::value::object>();
+		auto i = h.find("dialogRequestId");
+		size_t n = ns.size() + name.size() + (i == h.end() ? 0 : i->second.get<std::string>().size());
+		if (name == "SetAlert") {
+			n += at(payload, "token").get<std::string>().size() + at(payload, "type").get<std::string>().size() + at(payload, "scheduledTime").get<std::string>().size();
+		} else if (name == "Play") {
+			n += at(payload, "playBehavior").get<std::string>().size();
+			auto& stream = at(at(payload, "audioItem"), "stream");
+			n += at(stream, "url").get<std::string>().size() + at(stream, "token").get<std::string>().size();
+			auto& s = stream.get<picojson::value::object>();
+			auto j = s.find("progressReport");
+			if (j != s.end()) {
+				auto& r = j->second.get<picojson::value::object>();
+				auto delay = r.find("progressReportDelayInMilliseconds");
+				auto interval = r.find("progressReportIntervalInMilliseconds");
+				n += static_cast<size_t>((delay == r.end() ? 0.0 : delay->second.get<double>()) + (interval == r.end() ? 0.0 : interval->second.get<double>()));
+			}
+		} else if (name == "ExpectSpeech") {
+			n += static_cast<size_t>(at(payload, "timeoutInMilliseconds").get<double>());
+		} else {
+			n += static_cast<size_t>(at(payload, "volume").get<double>());
+		}
+		return n;
+	});
+	return 0;
+}
@@ -0,0 +1,200 @@
+#include <fstream>
+#include <random>
+#include <regex>
+
+#include "bench.h"
+#include "multipart.h"
+#include "multipart_summary.h"
+
+struct t_counter
+{
+	size_t v_parts = 0;
+	size_t v_bytes = 0;
+
+	void f_boundary()
+	{
+	}
+	void f_part(const std::string& a_type, const std::string& a_id)
+	{
+		++v_parts;
+	}
+	void f_content(const char* a_p, size_t a_n)
+	{
+		v_bytes += a_n;
+	}
+};
+
+struct t_generator
+{
+	std::mt19937 v_random;
+	std::string v_boundary;
+
+	t_generator(uint32_t a_seed, const std::string& a_boundary) : v_random(a_seed), v_boundary(a_boundary)
+	{
+	}
+	size_t f_next(size_t a_n)
+	{
+		return std::uniform_int_distribution<size_t>(0, a_n - 1)(v_random);
+	}
+	std::string f_near_miss()
+	{
+		std::string s = "\r\n--" + v_boundary;
+		switch (f_next(6)) {
+		case 0:
+			return s.substr(0, 1 + f_next(s.size() - 1));
+		case 1:
+			return s + v_boundary.back();
+		case 2:
+			return s + '-';
+		case 3:
+			return s + "---";
+		case 4:
+			return s + "\r\r\n";
+		default:
+			s[4 + f_next(v_boundary.size())] ^= 1;
+			return s + "\r\n";
+		}
+	}
+	std::string f_binary(size_t a_n, size_t a_near_misses)
+	{
+		std::string s;
+		s.reserve(a_n + a_near_misses * (v_boundary.size() + 8));
+		for (size_t i = 0; i < a_n; ++i) s += static_cast<char>(f_next(256));
+		for (size_t i = 0; i < a_near_misses; ++i) s.insert(f_next(s.size() + 1), f_near_miss());
+		return s;
+	}
+	std::string f_json(const std::string& a_namespace, const std::string& a_name, const std::string& a_payload)
+	{
+		return "{\"directive\":{\"header\":{\"namespace\":\"" + a_namespace + "\",\"name\":\"" + a_name + "\",\"messageId\":\"" + std::to_string(f_next(1000000)) + "\",\"dialogRequestId\":\"dialogRequestId-1\"},\"payload\":" + a_payload + "}}";
+	}
+	std::string f_stream(size_t a_directives, size_t a_audio, size_t a_near_misses)
+	{
+		std::string s;
+		for (size_t i = 0; i < a_directives; ++i) {
+			auto id = "audio-" + std::to_string(i);
+			s += "--" + v_boundary + "\r\n"
+			"Content-Type: application/json; charset=UTF-8\r\n"
+			"\r\n" + f_json("SpeechSynthesizer", "Speak", "{\"url\":\"cid:" + id + "\",\"format\":\"AUDIO_MPEG\",\"token\":\"" + id + "\"}") + "\r\n"
+			"--" + v_boundary + "\r\n"
+			"Content-Type: application/octet-stream\r\n"
+			"Content-ID: <" + id + ">\r\n"
+			"\r\n" + f_binary(a_audio, a_near_misses) + "\r\n";
+		}
+		return s + "--" + v_boundary + "--\r\n";
+	}
+};
+
+template<typename T_target, typename T_write>
+double f_measure(const std::string& a_boundary, const std::string& a_stream, size_t a_repeat, T_write a_write)
+{
+	auto bench = f_bench(a_repeat, [&](size_t)
+	{
+		T_target target;
+		t_multipart<T_target> multipart(target, a_boundary);
+		a_write(multipart, a_stream);
+		return target.v_parts;
+	});
+	std::fprintf(stderr, "%.1f MB/s, %.2f allocations/part\n", a_stream.size() * a_repeat / bench.v_seconds / (1024.0 * 1024.0), static_cast<double>(bench.v_allocations) / bench.v_result);
+	return bench.v_seconds;
+}
+
+int f_corpus(const std::string& a_directory)
+{
+	struct
+	{
+		const char* v_name;
+		uint32_t v_seed;
+		const char* v_boundary;
+		size_t v_directives;
+		size_t v_audio;
+		size_t v_near_misses;
+	} cases[] = {
+		{"speak", 1, "------abcde123", 1, 256, 0},
+		{"near-miss", 2, "------abcde123", 2, 128, 16},
+		{"short-boundary", 3, "foo", 3, 64, 24},
+		{"long-boundary", 4, "----------------------------------------0123456789abcdef", 2, 512, 8},
+		{"empty-parts", 5, "------abcde123", 4, 0, 0}
+	};
+	std::ofstream index(a_directory + "/index");
+	for (auto& x : cases) {
+		t_generator generator(x.v_seed, x.v_boundary);
+		auto stream = generator.f_stream(x.v_directives, x.v_audio, x.v_near_misses);
+		std::ofstream(a_directory + '/' + x.v_name, std::ios::binary) << x.v_boundary << '\n' << stream;
+		t_summary summary;
+		t_multipart<t_summary> multipart(summary, x.v_boundary);
+		for (char c : stream) multipart(c);
+		summary.f_close();
+		std::ofstream log(a_directory + '/' + x.v_name + ".log");
+		for (auto& y : summary.v_log) log << y << '\n';
+		index << x.v_name << '\n';
+	}
+	return 0;
+}
+
+// Compares the part header tokenizer with the regular expressions it replaced, over parts with many headers.
+void f_headers()
+{
+	std::regex re_content_type("content-type:\\s*([\\-0-9a-z]+/[\\-0-9a-z]+).*\r", std::regex::ECMAScript | std::regex::icase);
+	std::regex re_content_id("content-id:\\s*<\\s*(\\S+)\\s*>.*\r", std::regex::ECMAScript | std::regex::icase);
+	std::string headers;
+	for (size_t i = 0; i < 16; ++i) headers += "X-Header-" + std::to_string(i) + ": some value of a header line\r\n";
+	headers += "Content-Type: application/octet-stream\r\nContent-ID: <audio>\r\n";
+	std::string body;
+	const size_t parts = 1000;
+	for (size_t i = 0; i < parts; ++i) body += "--foo\r\n" + headers + "\r\n0123456789\r\n";
+	body += "--foo--\r\n";
+	t_counter target;
+	t_multipart<t_counter> multipart(target, "foo");
+	auto t0 = std::chrono::steady_clock::now();
+	multipart.f_write(body.data(), body.size());
+	auto t1 = std::chrono::steady_clock::now();
+	std::vector<std::string> lines;
+	for (size_t i = 0, j; (j = headers.find('\n', i)) != std::string::npos; i = j + 1) lines.push_back(headers.substr(i, j - i));
+	size_t matched = 0;
+	auto t2 = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < parts; ++i) for (auto& x : lines) {
+		std::smatch match;
+		if (std::regex_match(x, match, re_content_type) || std::regex_match(x, match, re_content_id)) ++matched;
+	}
+	auto t3 = std::chrono::steady_clock::now();
+	auto mbps = [&](auto a_duration)
+	{
+		return body.size() / std::chrono::duration<double>(a_duration).count() / (1024.0 * 1024.0);
+	};
+	std::fprintf(stderr, "headers: tokenizer %.1f MB/s (%zu parts), regex %.1f MB/s (%zu matched)\n", mbps(t1 - t0), target.v_parts, mbps(t3 - t2), matched);
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc == 3 && std::string(argv[1]) == "--corpus") return f_corpus(argv[2]);
+	if (argc != 1) {
+		std::fprintf(stderr, "usage: %s [--corpus <directory>]\n", argv[0]);
+		return -1;
+	}
+	const std::string boundary = "------abcde123";
+	t_generator generator(0, boundary);
+	auto stream = generator.f_stream(16, 1024 * 1024, 64);
+	std::fprintf(stderr, "stream: %zu bytes, 32 parts\n", stream.size());
+	std::fprintf(stderr, "operator(): ");
+	f_measure<t_counter>(boundary, stream, 4, [](auto& a_multipart, auto& a_stream)
+	{
+		for (char c : a_stream) a_multipart(c);
+	});
+	for (size_t n : {1, 16, 256, 1024, 16384}) {
+		std::fprintf(stderr, "f_write(%zu): ", n);
+		f_measure<t_counter>(boundary, stream, 4, [n](auto& a_multipart, auto& a_stream)
+		{
+			for (size_t i = 0; i < a_stream.size(); i += n) a_multipart.f_write(a_stream.data() + i, std::min(n, a_stream.size() - i));
+		});
+	}
+	auto small = generator.f_stream(2, 1024, 16);
+	std::fprintf(stderr, "split at every offset of %zu bytes: ", small.size());
+	f_measure<t_counter>(boundary, small, small.size() + 1, [i = size_t(0)](auto& a_multipart, auto& a_stream) mutable
+	{
+		a_multipart.f_write(a_stream.data(), i);
+		a_multipart.f_write(a_stream.data() + i, a_stream.size() - i);
+		++i;
+	});
+	f_headers();
+	return 0;
+}
@@ -0,0 +1,65 @@
+#include <regex>
+
+#include "bench.h"
+#include "tiny_http.h"
+
+template<typename T_run>
+void f_measure(const char* a_name, size_t a_repeat, T_run a_run)
+{
+	f_report(a_name, "op", a_repeat, f_bench(a_repeat, [&](size_t)
+	{
+		return a_run();
+	}));
+}
+
+int main(int argc, char* argv[])
+{
+	const std::string url = "https://api.amazon.com/auth/o2/token";
+	const std::string query = "code=ANdNAVhyhqirUelHGEHA%2Bexample%2Fcode&scope=alexa%3Aall";
+	const std::string value = "{\"alexa:all\":{\"productID\":\"my_device\",\"productInstanceAttributes\":{\"deviceSerialNumber\":\"123456\"}}}";
+	const size_t repeat = 200000;
+	f_measure("std::regex url", repeat / 10, [&]
+	{
+		std::smatch match;
+		std::regex_match(url, match, std::regex{"(https?)://([^/]+)(.*)"});
+		return match[2].length();
+	});
+	f_measure("f_split_url", repeat, [&]
+	{
+		const char* host = nullptr;
+		const char* path = nullptr;
+		f_split_url(url.data(), url.data() + url.size(), host, path);
+		return static_cast<size_t>(path - host);
+	});
+	f_measure("f_parse_query_string", repeat, [&]
+	{
+		return f_parse_query_string(query)["code"].size();
+	});
+	std::string code;
+	f_measure("f_find_query", repeat, [&]
+	{
+		f_find_query(query, "code", code);
+		return code.size();
+	});
+	char buffer[1024];
+	f_measure("f_uri_encode", repeat, [&]
+	{
+		return static_cast<size_t>(f_uri_encode(value.begin(), value.end(), buffer) - buffer);
+	});
+	auto encoded = std::string(buffer, f_uri_encode(value.begin(), value.end(), buffer));
+	f_measure("f_uri_decode", repeat, [&]
+	{
+		return static_cast<size_t>(f_uri_decode(encoded.begin(), encoded.end(), buffer) - buffer);
+	});
+	f_measure("f_build_query_string", repeat, [&]
+	{
+		return f_build_query_string({
+			{"client_id", "amzn1.application-oa2-client.0123456789abcdef"},
+			{"scope", "alexa:all"},
+			{"scope_data", value},
+			{"response_type", "code"},
+			{"redirect_uri", "https://localhost:3000/grant"}
+		}).size();
+	});
+	return 0;
+}
@@ -0,0 +1,28 @@
+#ifndef ALEXAAGENT__COUNTING_NEW_H
+#define ALEXAAGENT__COUNTING_NEW_H
+
+#include <cstdlib>
+#include <new>
+
+#include "allocation.h"
+
+// Replaces the global operator new to feed t_allocation_scope.
+// These are definitions, so include this in exactly one translation unit of a program.
+void* operator new(size_t a_n)
+{
+	t_allocation_scope::f_count(a_n);
+	if (void* p = std::malloc(a_n)) return p;
+	throw std::bad_alloc();
+}
+
+void operator delete(void* a_p) noexcept
+{
+	std::free(a_p);
+}
+
+void operator delete(void* a_p, size_t) noexcept
+{
+	std::free(a_p);
+}
+
+#endif
@@ -1,65 +1,126 @@
 #ifndef ALEXAAGENT__JSON_H
 #define ALEXAAGENT__JSON_H
 
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iterator>
+#include <stdexcept>
+#include <vector>
 #include <picojson/picojson.h>
 
+struct t_json_key
+{
+	const char* v_p;
+	size_t v_n;
+
+	constexpr t_json_key(const char* a_p, size_t a_n) : v_p(a_p), v_n(a_n)
+	{
+	}
+	// Up to the first NUL, which for a literal is its last element, but not for any other array.
+	template<size_t N>
+	constexpr t_json_key(const char (&a_p)[N]) : v_p(a_p), v_n(f_length(a_p, N))
+	{
+	}
+	t_json_key(const std::string& a_x) : v_p(a_x.data()), v_n(a_x.size())
+	{
+	}
+
+private:
+	static constexpr size_t f_length(const char* a_p, size_t a_n)
+	{
+		size_t n = 0;
+		while (n < a_n && a_p[n] != '\0') ++n;
+		return n;
+	}
+};
+
+inline bool operator==(const t_json_key& a_x, const t_json_key& a_y)
+{
+	return a_x.v_n == a_y.v_n && std::memcmp(a_x.v_p, a_y.v_p, a_x.v_n) == 0;
+}
+
+inline bool operator!=(const t_json_key& a_x, const t_json_key& a_y)
+{
+	return !(a_x == a_y);
+}
+
+// picojson's std::map has no transparent comparator, so the key is copied into a reused string to find it in O(log n).
+template<typename T_object>
+inline auto f_json_find(T_object& a_object, const t_json_key& a_key) -> decltype(a_object.begin())
+{
+	static thread_local std::string key;
+	key.assign(a_key.v_p, a_key.v_n);
+	return a_object.find(key);
+}
+
+template<typename T_object>
+inline auto f_json_at(T_object& a_object, const t_json_key& a_key) -> decltype((a_object.begin()->second))
+{
+	auto i = f_json_find(a_object, a_key);
+	if (i == a_object.end()) throw std::out_of_range("no such key: " + std::string(a_key.v_p, a_key.v_n));
+	return i->second;
+}
+
 template<typename T>
 struct t_get
 {
-	std::string v_name;
+	t_json_key v_name;
 };
 
 template<typename T>
 inline T& operator/(picojson::value& a_value, const t_get<T>& a_get)
 {
-	return a_value.get<picojson::value::object>().at(a_get.v_name).template get<T>();
+	return f_json_at(a_value.get<picojson::value::object>(), a_get.v_name).template get<T>();
 }
 
 template<typename T>
 inline const T& operator/(const picojson::value& a_value, const t_get<T>& a_get)
 {
-	return a_value.get<picojson::value::object>().at(a_get.v_name).template get<T>();
+	return f_json_at(a_value.get<picojson::value::object>(), a_get.v_name).template get<T>();
 }
 
-inline t_get<bool> operator""_jsb(const char* a_name, size_t a_n)
+constexpr t_get<bool> operator""_jsb(const char* a_name, size_t a_n)
 {
-	return t_get<bool>{std::string(a_name, a_n)};
+	return t_get<bool>{{a_name, a_n}};
 }
 
-inline t_get<double> operator""_jsn(const char* a_name, size_t a_n)
+constexpr t_get<double> operator""_jsn(const char* a_name, size_t a_n)
 {
-	return t_get<double>{std::string(a_name, a_n)};
+	return t_get<double>{{a_name, a_n}};
 }
 
-inline t_get<std::string> operator""_jss(const char* a_name, size_t a_n)
+constexpr t_get<std::string> operator""_jss(const char* a_name, size_t a_n)
 {
-	return t_get<std::string>{std::string(a_name, a_n)};
+	return t_get<std::string>{{a_name, a_n}};
 }
 
-inline t_get<picojson::value::array> operator""_jsa(const char* a_name, size_t a_n)
+constexpr t_get<picojson::value::array> operator""_jsa(const char* a_name, size_t a_n)
 {
-	return t_get<picojson::value::array>{std::string(a_name, a_n)};
+	return t_get<picojson::value::array>{{a_name, a_n}};
 }
 
-inline t_get<picojson::value::object> operator""_jso(const char* a_name, size_t a_n)
+constexpr t_get<picojson::value::object> operator""_jso(const char* a_name, size_t a_n)
 {
-	return t_get<picojson::value::object>{std::string(a_name, a_n)};
+	return t_get<picojson::value::object>{{a_name, a_n}};
 }
 
-inline picojson::value& operator/(picojson::value& a_value, const std::string& a_name)
+inline picojson::value& operator/(picojson::value& a_value, const t_json_key& a_name)
 {
-	return a_value.get<picojson::value::object>().at(a_name);
+	return f_json_at(a_value.get<picojson::value::object>(), a_name);
 }
 
-inline const picojson::value& operator/(const picojson::value& a_value, const std::string& a_name)
+inline const picojson::value& operator/(const picojson::value& a_value, const t_json_key& a_name)
 {
-	return a_value.get<picojson::value::object>().at(a_name);
+	return f_json_at(a_value.get<picojson::value::object>(), a_name);
 }
 
-inline std::pair<picojson::value::object::const_iterator, picojson::value::object::const_iterator> operator*(const picojson::value& a_value, const std::string& a_name)
+inline std::pair<picojson::value::object::const_iterator, picojson::value::object::const_iterator> operator*(const picojson::value& a_value, const t_json_key& a_name)
 {
 	auto& x = a_value.get<picojson::value::object>();
-	return std::make_pair(x.find(a_name), x.end());
+	return std::make_pair(f_json_find(x, a_name), x.end());
 }
 
 template<typename T>
@@ -96,4 +157,498 @@ inline picojson::value& operator&(t_set a_set, T&& a_x)
 	return a_set.v_value;
 }
 
+class t_json_parser
+{
+	enum t_state
+	{
+		e_state__VALUE,
+		e_state__OBJECT,
+		e_state__KEY,
+		e_state__COLON,
+		e_state__ARRAY,
+		e_state__NEXT,
+		e_state__STRING,
+		e_state__ESCAPE,
+		e_state__UNICODE,
+		e_state__NUMBER,
+		e_state__LITERAL,
+		e_state__DONE,
+		e_state__ERROR
+	};
+	struct t_frame
+	{
+		picojson::value* v_value;
+		bool v_object;
+	};
+
+	static bool f_space(char a_c)
+	{
+		return a_c == ' ' || a_c == '\t' || a_c == '\n' || a_c == '\r';
+	}
+
+	picojson::value v_root;
+	std::vector<t_frame> v_stack;
+	std::vector<t_json_key> v_path;
+	// Backs v_path, one string per depth; kept across directives so that their buffers are reused.
+	std::deque<std::string> v_keys;
+	t_state v_state = e_state__VALUE;
+	picojson::value* v_slot = nullptr;
+	bool v_key = false;
+	std::string v_string;
+	unsigned v_unicode = 0;
+	unsigned v_digits = 0;
+	unsigned v_surrogate = 0;
+
+	void f_utf8(unsigned a_c)
+	{
+		if (a_c < 0x80) {
+			v_string += static_cast<char>(a_c);
+		} else if (a_c < 0x800) {
+			v_string += static_cast<char>(0xc0 | a_c >> 6);
+			v_string += static_cast<char>(0x80 | (a_c & 0x3f));
+		} else if (a_c < 0x10000) {
+			v_string += static_cast<char>(0xe0 | a_c >> 12);
+			v_string += static_cast<char>(0x80 | (a_c >> 6 & 0x3f));
+			v_string += static_cast<char>(0x80 | (a_c & 0x3f));
+		} else {
+			v_string += static_cast<char>(0xf0 | a_c >> 18);
+			v_string += static_cast<char>(0x80 | (a_c >> 12 & 0x3f));
+			v_string += static_cast<char>(0x80 | (a_c >> 6 & 0x3f));
+			v_string += static_cast<char>(0x80 | (a_c & 0x3f));
+		}
+	}
+	picojson::value* f_begin()
+	{
+		if (v_stack.empty()) return &v_root;
+		auto& top = v_stack.back();
+		if (top.v_object) {
+			if (v_keys.size() <= v_path.size()) v_keys.emplace_back();
+			auto& key = v_keys[v_path.size()];
+			key.assign(v_string);
+			v_path.emplace_back(key);
+		} else {
+			v_path.emplace_back("", 0);
+		}
+		if (!top.v_value || (v_enter && !v_enter(v_path))) return nullptr;
+		if (!top.v_object) {
+			auto& array = top.v_value->get<picojson::value::array>();
+			array.emplace_back();
+			return &array.back();
+		}
+		auto& x = top.v_value->get<picojson::value::object>()[v_string];
+		x = picojson::value();
+		return &x;
+	}
+	void f_end(picojson::value* a_value)
+	{
+		if (a_value && v_leave) v_leave(v_path, *a_value);
+		if (v_stack.empty()) {
+			v_state = e_state__DONE;
+		} else {
+			v_path.pop_back();
+			v_state = e_state__NEXT;
+		}
+	}
+	template<typename T>
+	void f_scalar(T&& a_x)
+	{
+		if (v_slot) *v_slot = picojson::value(std::forward<T>(a_x));
+		f_end(v_slot);
+	}
+	static bool f_digits(const char*& a_p)
+	{
+		if (*a_p < '0' || *a_p > '9') return false;
+		do ++a_p; while (*a_p >= '0' && *a_p <= '9');
+		return true;
+	}
+	// -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?, which strtod alone would loosen to 01, 1. and the like.
+	bool f_number_valid() const
+	{
+		auto p = v_string.c_str();
+		if (*p == '-') ++p;
+		if (*p == '0')
+			++p;
+		else if (!f_digits(p))
+			return false;
+		if (*p == '.' && !f_digits(++p)) return false;
+		if (*p == 'e' || *p == 'E') {
+			if (*++p == '+' || *p == '-') ++p;
+			if (!f_digits(p)) return false;
+		}
+		return *p == '\0';
+	}
+	bool f_number()
+	{
+		if (!f_number_valid()) return false;
+		char* p;
+		double x = std::strtod(v_string.c_str(), &p);
+		if (v_string.empty() || *p != '\0') return false;
+		f_scalar(x);
+		return true;
+	}
+	bool f_literal()
+	{
+		if (v_string == "true")
+			f_scalar(true);
+		else if (v_string == "false")
+			f_scalar(false);
+		else if (v_string == "null")
+			f_scalar(picojson::value());
+		else
+			return false;
+		return true;
+	}
+	bool f_value(char a_c)
+	{
+		switch (a_c) {
+		case '{':
+		case '[':
+			{
+				auto p = f_begin();
+				bool object = a_c == '{';
+				if (p) *p = object ? picojson::value(picojson::value::object()) : picojson::value(picojson::value::array());
+				v_stack.push_back({p, object});
+				v_state = object ? e_state__OBJECT : e_state__ARRAY;
+			}
+			return true;
+		case '"':
+			v_slot = f_begin();
+			v_key = false;
+			v_string.clear();
+			v_state = e_state__STRING;
+			return true;
+		case '-':
+		case '0':
+		case '1':
+		case '2':
+		case '3':
+		case '4':
+		case '5':
+		case '6':
+		case '7':
+		case '8':
+		case '9':
+			v_slot = f_begin();
+			v_string.assign(1, a_c);
+			v_state = e_state__NUMBER;
+			return true;
+		case 't':
+		case 'f':
+		case 'n':
+			v_slot = f_begin();
+			v_string.assign(1, a_c);
+			v_state = e_state__LITERAL;
+			return true;
+		default:
+			return false;
+		}
+	}
+	void f_close()
+	{
+		auto p = v_stack.back().v_value;
+		v_stack.pop_back();
+		f_end(p);
+	}
+	bool f_step(char a_c)
+	{
+		switch (v_state) {
+		case e_state__VALUE:
+			return f_space(a_c) || f_value(a_c);
+		case e_state__OBJECT:
+			if (a_c == '}') {
+				f_close();
+				return true;
+			}
+			// fall through
+		case e_state__KEY:
+			if (f_space(a_c)) return true;
+			if (a_c != '"') return false;
+			v_key = true;
+			v_string.clear();
+			v_state = e_state__STRING;
+			return true;
+		case e_state__COLON:
+			if (f_space(a_c)) return true;
+			if (a_c != ':') return false;
+			v_state = e_state__VALUE;
+			return true;
+		case e_state__ARRAY:
+			if (a_c == ']') {
+				f_close();
+				return true;
+			}
+			return f_space(a_c) || f_value(a_c);
+		case e_state__NEXT:
+			if (f_space(a_c)) return true;
+			if (a_c == ',') {
+				v_state = v_stack.back().v_object ? e_state__KEY : e_state__VALUE;
+				return true;
+			}
+			if (a_c != (v_stack.back().v_object ? '}' : ']')) return false;
+			f_close();
+			return true;
+		case e_state__STRING:
+			if (v_surrogate && a_c != '\\') return false;
+			if (a_c == '"') {
+				if (v_key) {
+					v_state = e_state__COLON;
+				} else {
+					f_scalar(std::move(v_string));
+					v_string.clear();
+				}
+			} else if (a_c == '\\') {
+				v_state = e_state__ESCAPE;
+			} else if (static_cast<unsigned char>(a_c) < 0x20) {
+				return false;
+			} else {
+				v_string += a_c;
+			}
+			return true;
+		case e_state__ESCAPE:
+			if (v_surrogate && a_c != 'u') return false;
+			v_state = e_state__STRING;
+			switch (a_c) {
+			case '"':
+			case '\\':
+			case '/':
+				v_string += a_c;
+				return true;
+			case 'b':
+				v_string += '\b';
+				return true;
+			case 'f':
+				v_string += '\f';
+				return true;
+			case 'n':
+				v_string += '\n';
+				return true;
+			case 'r':
+				v_string += '\r';
+				return true;
+			case 't':
+				v_string += '\t';
+				return true;
+			case 'u':
+				v_unicode = v_digits = 0;
+				v_state = e_state__UNICODE;
+				return true;
+			default:
+				return false;
+			}
+		case e_state__UNICODE:
+			if (a_c >= '0' && a_c <= '9')
+				v_unicode = v_unicode << 4 | (a_c - '0');
+			else if (a_c >= 'A' && a_c <= 'F')
+				v_unicode = v_unicode << 4 | (a_c - 'A' + 10);
+			else if (a_c >= 'a' && a_c <= 'f')
+				v_unicode = v_unicode << 4 | (a_c - 'a' + 10);
+			else
+				return false;
+			if (++v_digits < 4) return true;
+			v_state = e_state__STRING;
+			if (v_unicode >= 0xd800 && v_unicode < 0xdc00) {
+				if (v_surrogate) return false;
+				v_surrogate = v_unicode;
+				return true;
+			}
+			if (v_unicode >= 0xdc00 && v_unicode < 0xe000) {
+				if (!v_surrogate) return false;
+				f_utf8(0x10000 + ((v_surrogate - 0xd800) << 10) + (v_unicode - 0xdc00));
+				v_surrogate = 0;
+				return true;
+			}
+			if (v_surrogate) return false;
+			f_utf8(v_unicode);
+			return true;
+		case e_state__NUMBER:
+			if ((a_c >= '0' && a_c <= '9') || a_c == '.' || a_c == 'e' || a_c == 'E' || a_c == '+' || a_c == '-') {
+				v_string += a_c;
+				return true;
+			}
+			return f_number() && f_step(a_c);
+		case e_state__LITERAL:
+			if (a_c >= 'a' && a_c <= 'z') {
+				v_string += a_c;
+				return v_string.size() <= 5;
+			}
+			return f_literal() && f_step(a_c);
+		case e_state__DONE:
+			return f_space(a_c);
+		default:
+			return false;
+		}
+	}
+
+public:
+	std::function<bool(const std::vector<t_json_key>&)> v_enter;
+	std::function<void(const std::vector<t_json_key>&, const picojson::value&)> v_leave;
+
+	picojson::value& f_value()
+	{
+		return v_root;
+	}
+	void f_reset()
+	{
+		v_root = picojson::value();
+		v_stack.clear();
+		v_path.clear();
+		v_state = e_state__VALUE;
+		v_slot = nullptr;
+		v_surrogate = 0;
+	}
+	bool operator()(const char* a_p, size_t a_n)
+	{
+		for (auto q = a_p + a_n; a_p < q; ++a_p) {
+			if (f_step(*a_p)) continue;
+			v_state = e_state__ERROR;
+			return false;
+		}
+		return true;
+	}
+	bool f_finish()
+	{
+		if (v_state == e_state__NUMBER && v_stack.empty()) f_number();
+		if (v_state == e_state__LITERAL && v_stack.empty()) f_literal();
+		return v_state == e_state__DONE;
+	}
+};
+
+class t_json_writer
+{
+	std::string& v_s;
+	bool v_first = true;
+
+	void f_separate()
+	{
+		if (!v_first) v_s += ',';
+		v_first = false;
+	}
+
+public:
+	t_json_writer(std::string& a_s) : v_s(a_s)
+	{
+	}
+	t_json_writer& f_begin_object()
+	{
+		f_separate();
+		v_s += '{';
+		v_first = true;
+		return *this;
+	}
+	t_json_writer& f_end_object()
+	{
+		v_s += '}';
+		v_first = false;
+		return *this;
+	}
+	t_json_writer& f_begin_array()
+	{
+		f_separate();
+		v_s += '[';
+		v_first = true;
+		return *this;
+	}
+	t_json_writer& f_end_array()
+	{
+		v_s += ']';
+		v_first = false;
+		return *this;
+	}
+	t_json_writer& f_key(const t_json_key& a_key)
+	{
+		f_value(a_key.v_p, a_key.v_n);
+		v_s += ':';
+		v_first = true;
+		return *this;
+	}
+	t_json_writer& f_value(const char* a_p, size_t a_n)
+	{
+		f_separate();
+		v_s += '"';
+		for (auto q = a_p + a_n; a_p < q; ++a_p) {
+			char c = *a_p;
+			switch (c) {
+			case '"':
+				v_s += "\\\"";
+				break;
+			case '\\':
+				v_s += "\\\\";
+				break;
+			case '/':
+				v_s += "\\/";
+				break;
+			case '\b':
+				v_s += "\\b";
+				break;
+			case '\f':
+				v_s += "\\f";
+				break;
+			case '\n':
+				v_s += "\\n";
+				break;
+			case '\r':
+				v_s += "\\r";
+				break;
+			case '\t':
+				v_s += "\\t";
+				break;
+			default:
+				if (static_cast<unsigned char>(c) < 0x20 || c == 0x7f) {
+					char s[7];
+					std::sprintf(s, "\\u%04x", c & 0xff);
+					v_s += s;
+				} else {
+					v_s += c;
+				}
+			}
+		}
+		v_s += '"';
+		return *this;
+	}
+	t_json_writer& f_value(const char* a_x)
+	{
+		return f_value(a_x, std::strlen(a_x));
+	}
+	t_json_writer& f_value(const std::string& a_x)
+	{
+		return f_value(a_x.data(), a_x.size());
+	}
+	t_json_writer& f_value(bool a_x)
+	{
+		f_separate();
+		v_s += a_x ? "true" : "false";
+		return *this;
+	}
+	t_json_writer& f_value(long a_x)
+	{
+		f_separate();
+		char s[32];
+		std::sprintf(s, "%ld", a_x);
+		v_s += s;
+		return *this;
+	}
+	t_json_writer& f_value(double a_x)
+	{
+		if (!std::isfinite(a_x)) throw std::overflow_error("json: non-finite number");
+		f_separate();
+		char s[256];
+		double x;
+		std::sprintf(s, std::fabs(a_x) < (1ULL << 53) && std::modf(a_x, &x) == 0 ? "%.f" : "%.17g", a_x);
+		v_s += s;
+		return *this;
+	}
+	t_json_writer& f_value(const picojson::value& a_x)
+	{
+		f_separate();
+		a_x.serialize(std::back_inserter(v_s));
+		return *this;
+	}
+	t_json_writer& f_raw(const std::string& a_x)
+	{
+		f_separate();
+		v_s += a_x;
+		return *this;
+	}
+};
+
 #endif
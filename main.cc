@@ -3,6 +3,10 @@
 #include <Simple-WebSocket-Server/server_wss.hpp>
 
 #include "agent.h"
+// Allocation accounting is for debug builds only; release builds keep the default allocator.
+#ifndef NDEBUG
+#include "counting_new.h"
+#endif
 
 template<typename T_server>
 void f_web_socket(t_agent& a_agent, std::shared_ptr<T_server> a_server, std::promise<void>&& a_ready)
@@ -47,6 +51,18 @@ void f_web_socket(t_agent& a_agent, std::shared_ptr<T_server> a_server, std::pro
 		{
 			session.f_content_can_play_in_background(a_x.template get<bool>());
 		}},
+		{"audio.convert", [&](auto a_x)
+		{
+			session.f_audio_convert(a_x.template get<bool>());
+		}},
+		{"audio.decode_ahead", [&](auto a_x)
+		{
+			session.f_decode_ahead(a_x.template get<bool>());
+		}},
+		{"audio.attached_buffer", [&](auto a_x)
+		{
+			session.f_attached_buffer(static_cast<size_t>(a_x.template get<double>()));
+		}},
 		{"speaker.volume", [&](auto a_x)
 		{
 			session.f_speaker_volume(a_x.template get<double>());
@@ -134,6 +150,11 @@ void f_web_socket(t_agent& a_agent, std::shared_ptr<T_server> a_server, std::pro
 			{"content", picojson::value(picojson::value::object{
 				{"can_play_in_background", picojson::value(session.f_content_can_play_in_background())}
 			})},
+			{"audio", picojson::value(picojson::value::object{
+				{"convert", picojson::value(session.f_audio_convert())},
+				{"decode_ahead", picojson::value(session.f_decode_ahead())},
+				{"attached_buffer", picojson::value(static_cast<double>(session.f_attached_buffer()))}
+			})},
 			{"speaker", picojson::value(picojson::value::object{
 				{"volume", picojson::value(static_cast<double>(session.f_speaker_volume()))},
 				{"muted", picojson::value(session.f_speaker_muted())}
@@ -237,12 +258,11 @@ int main(int argc, char* argv[])
 	auto to_root = nghttp2::asio_http2::server::redirect_handler(302, "/");
 	server.handle("/grant", [&](auto& a_request, auto& a_response)
 	{
-		auto values = f_parse_query_string(a_request.uri().raw_query);
-		auto i = values.find("code");
-		if (i == values.end())
+		std::string code;
+		if (!f_find_query(a_request.uri().raw_query, "code", code))
 			to_root(a_request, a_response);
 		else
-			agent.f_grant(i->second, [&](auto)
+			agent.f_grant(code, [&](auto)
 			{
 				if (agent.f_session()) wsstart();
 				to_root(a_request, a_response);
@@ -1,23 +1,58 @@
 #ifndef ALEXAAGENT__MULTIPART_H
 #define ALEXAAGENT__MULTIPART_H
 
-#include <regex>
+#include <algorithm>
+#include <cstring>
+#include <string>
 #include <vector>
 
 template<typename T_target>
 class t_multipart
 {
-	static std::regex v_re_content_type;
-	static std::regex v_re_content_id;
+	static bool f_space(char a_c)
+	{
+		switch (a_c) {
+		case ' ':
+		case '\t':
+		case '\n':
+		case '\v':
+		case '\f':
+		case '\r':
+			return true;
+		default:
+			return false;
+		}
+	}
+	static bool f_token(char a_c)
+	{
+		return (a_c >= '0' && a_c <= '9') || (a_c >= 'A' && a_c <= 'Z') || (a_c >= 'a' && a_c <= 'z') || a_c == '-';
+	}
+	static bool f_name(const char* a_p, const char* a_q, const char* a_name)
+	{
+		for (; a_p < a_q; ++a_p, ++a_name) {
+			char c = *a_p;
+			if (c >= 'A' && c <= 'Z') c += 'a' - 'A';
+			if (c != *a_name) return false;
+		}
+		return *a_name == '\0';
+	}
+	static bool f_rest(const char* a_p, const char* a_q)
+	{
+		for (; a_p < a_q; ++a_p) if (*a_p == '\r' || *a_p == '\n') return false;
+		return true;
+	}
 
 	T_target& v_target;
 	std::string v_boundary;
 	const char* v_suffix;
 	size_t v_last = 2;;
+	size_t v_skip[256];
 	char v_buffer[1024];
 	char* v_p = v_buffer;
 	size_t (t_multipart::*v_write)(const char*, size_t) = &t_multipart::f_write_ignore;
 	std::vector<char> v_line;
+	size_t v_line_size = 0;
+	bool v_line_cr = false;
 	std::string v_content_type;
 	std::string v_content_id;
 
@@ -25,28 +60,58 @@ class t_multipart
 	{
 		return a_n;
 	}
+	void f_header(const char* a_p, const char* a_q)
+	{
+		auto colon = static_cast<const char*>(std::memchr(a_p, ':', a_q - a_p));
+		if (!colon) return;
+		auto p = colon + 1;
+		while (p < a_q && f_space(*p)) ++p;
+		if (f_name(a_p, colon, "content-type")) {
+			auto q = p;
+			while (q < a_q && f_token(*q)) ++q;
+			if (q == p || q == a_q || *q != '/') return;
+			auto r = ++q;
+			while (r < a_q && f_token(*r)) ++r;
+			if (r > q && f_rest(r, a_q)) v_content_type.assign(p, r);
+		} else if (f_name(a_p, colon, "content-id")) {
+			if (p == a_q || *p != '<') return;
+			while (++p < a_q && f_space(*p));
+			auto q = p;
+			while (q < a_q && !f_space(*q)) ++q;
+			if (q == p) return;
+			auto r = q;
+			while (r < a_q && f_space(*r)) ++r;
+			if (r < a_q && *r == '>') {
+				if (f_rest(++r, a_q)) v_content_id.assign(p, q);
+				return;
+			}
+			while (--q > p) if (*q == '>') {
+				if (f_rest(q + 1, a_q)) v_content_id.assign(p, q);
+				return;
+			}
+		}
+	}
 	size_t f_write_header(const char* a_p, size_t a_n)
 	{
 		for (size_t i = 0; i < a_n; ++i) {
 			char c = a_p[i];
-			if (c == '\n' && !v_line.empty() && v_line.back() == '\r') {
-				if (v_line.size() == 1) {
+			if (c == '\n' && v_line_cr) {
+				if (v_line_size == 1) {
 					v_target.f_part(v_content_type, v_content_id);
 					v_content_type.clear();
 					v_content_id.clear();
-					v_line.clear();
+					v_line_size = 0;
+					v_line_cr = false;
 					v_write = &t_multipart::f_write_content;
 					return ++i;
-				} else {
-					std::match_results<std::vector<char>::iterator> match;
-					if (std::regex_match(v_line.begin(), v_line.end(), match, v_re_content_type))
-						v_content_type = match[1].str();
-					else if (std::regex_match(v_line.begin(), v_line.end(), match, v_re_content_id))
-						v_content_id = match[1].str();
-					v_line.clear();
 				}
+				if (v_line_size <= v_line.size()) f_header(v_line.data(), v_line.data() + v_line_size - 1);
+				v_line_size = 0;
+				v_line_cr = false;
 			} else {
-				v_line.push_back(c);
+				if (v_line_size < v_line.size()) v_line[v_line_size] = c;
+				if (v_line_size <= v_line.size()) ++v_line_size;
+				v_line_cr = c == '\r';
 			}
 		}
 		return a_n;
@@ -56,7 +121,7 @@ class t_multipart
 		v_target.f_content(a_p, a_n);
 		return a_n;
 	}
-	void f_write(const char* a_p, size_t a_n)
+	void f_dispatch(const char* a_p, size_t a_n)
 	{
 		while (true) {
 			size_t n = (this->*v_write)(a_p, a_n);
@@ -67,13 +132,50 @@ class t_multipart
 	}
 	void f_flush()
 	{
-		f_write(v_buffer, v_p - v_buffer);
+		f_dispatch(v_buffer, v_p - v_buffer);
 		v_p = v_buffer;
 	}
+	const char* f_find(const char* a_p, const char* a_q) const
+	{
+		size_t m = v_boundary.size();
+		const char* boundary = v_boundary.data();
+		while (a_q - a_p >= static_cast<ptrdiff_t>(m)) {
+			unsigned char c = a_p[m - 1];
+			if (c == static_cast<unsigned char>(boundary[m - 1]) && std::memcmp(a_p, boundary, m - 1) == 0) return a_p;
+			a_p += v_skip[c];
+		}
+		return nullptr;
+	}
 
 public:
-	t_multipart(T_target& a_target, const std::string& a_boundary) : v_target(a_target), v_boundary("\r\n--" + a_boundary)
+	t_multipart(T_target& a_target, const std::string& a_boundary, size_t a_header_limit = 1024) : v_target(a_target), v_boundary("\r\n--" + a_boundary), v_line(std::max(a_header_limit, size_t(1)))
+	{
+		size_t m = v_boundary.size();
+		std::fill_n(v_skip, 256, m);
+		for (size_t i = 0; i < m - 1; ++i) v_skip[static_cast<unsigned char>(v_boundary[i])] = m - 1 - i;
+	}
+	void f_write(const char* a_p, size_t a_n)
 	{
+		auto q = a_p + a_n;
+		while (a_p < q) {
+			if (v_last > 0) {
+				(*this)(*a_p++);
+				continue;
+			}
+			auto p = f_find(a_p, q);
+			size_t n = v_boundary.size();
+			if (!p) {
+				p = q - a_p < static_cast<ptrdiff_t>(n) ? a_p : q - n + 1;
+				p = static_cast<const char*>(std::memchr(p, '\r', q - p));
+				if (!p) p = q;
+				n = 1;
+			}
+			if (v_p > v_buffer) f_flush();
+			if (p > a_p) f_dispatch(a_p, p - a_p);
+			if (p >= q) break;
+			v_last = n;
+			a_p = p + n;
+		}
 	}
 	void operator()(char a_c)
 	{
@@ -83,7 +185,7 @@ public:
 					++v_last;
 					return;
 				}
-				f_write(v_boundary.c_str(), v_last);
+				f_dispatch(v_boundary.c_str(), v_last);
 			} else {
 				size_t i = v_last - v_boundary.size();
 				if (i == 0) {
@@ -97,7 +199,7 @@ public:
 						++v_last;
 						return;
 					}
-					f_write(v_boundary.c_str(), v_last);
+					f_dispatch(v_boundary.c_str(), v_last);
 				} else if (a_c == v_suffix[i]) {
 					if (v_suffix[++i] == '\0') {
 						v_target.f_boundary();
@@ -108,8 +210,8 @@ public:
 					}
 					return;
 				} else {
-					f_write(v_boundary.c_str(), v_boundary.size());
-					f_write(v_suffix, i);
+					f_dispatch(v_boundary.c_str(), v_boundary.size());
+					f_dispatch(v_suffix, i);
 				}
 			}
 			v_last = 0;
@@ -124,9 +226,4 @@ public:
 	}
 };
 
-template<typename T_target>
-std::regex t_multipart<T_target>::v_re_content_type("content-type:\\s*([\\-0-9a-z]+/[\\-0-9a-z]+).*\r", std::regex::ECMAScript | std::regex::icase);
-template<typename T_target>
-std::regex t_multipart<T_target>::v_re_content_id("content-id:\\s*<\\s*(\\S+)\\s*>.*\r", std::regex::ECMAScript | std::regex::icase);
-
 #endif
@@ -0,0 +1,46 @@
+#ifndef ALEXAAGENT__MULTIPART_SUMMARY_H
+#define ALEXAAGENT__MULTIPART_SUMMARY_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// A t_multipart target that logs boundaries and parts, and each content as its size and FNV-1a hash, as in corpus/multipart/*.log.
+struct t_summary
+{
+	std::vector<std::string> v_log;
+	size_t v_size = 0;
+	uint32_t v_hash = 2166136261u;
+	bool v_content = false;
+
+	void f_close()
+	{
+		if (!v_content) return;
+		char s[64];
+		std::sprintf(s, "content: %zu %08x", v_size, v_hash);
+		v_log.push_back(s);
+		v_size = 0;
+		v_hash = 2166136261u;
+		v_content = false;
+	}
+	void f_boundary()
+	{
+		f_close();
+		v_log.push_back("boundary");
+	}
+	void f_part(const std::string& a_type, const std::string& a_id)
+	{
+		f_close();
+		v_log.push_back("part: " + a_type + ", " + a_id);
+	}
+	void f_content(const char* a_p, size_t a_n)
+	{
+		if (a_n <= 0) return;
+		v_size += a_n;
+		for (size_t i = 0; i < a_n; ++i) v_hash = (v_hash ^ static_cast<unsigned char>(a_p[i])) * 16777619u;
+		v_content = true;
+	}
+};
+
+#endif
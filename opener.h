@@ -0,0 +1,160 @@
+#ifndef ALEXAAGENT__OPENER_H
+#define ALEXAAGENT__OPENER_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Runs blocking opens on a fixed set of threads.
+// Every job is handed a flag that is raised once the job is cancelled, so that a running open can give up early.
+class t_opener_pool
+{
+public:
+	typedef std::shared_ptr<std::atomic<bool>> t_cancellation;
+
+private:
+	struct t_job
+	{
+		t_cancellation v_cancelled;
+		std::function<void(const t_cancellation&)> v_open;
+		std::chrono::steady_clock::time_point v_queued;
+	};
+
+	mutable std::mutex v_mutex;
+	std::condition_variable v_condition;
+	std::deque<t_job> v_jobs;
+	std::vector<t_cancellation> v_running;
+	bool v_stopping = false;
+	size_t v_depth_max = 0;
+	size_t v_opens = 0;
+	size_t v_cancels = 0;
+	std::chrono::steady_clock::duration v_latency{};
+	std::chrono::steady_clock::duration v_latency_max{};
+	std::vector<std::thread> v_threads;
+
+	void f_run()
+	{
+		std::unique_lock<std::mutex> lock(v_mutex);
+		while (true) {
+			v_condition.wait(lock, [this]
+			{
+				return v_stopping || !v_jobs.empty();
+			});
+			if (v_stopping) break;
+			auto job = std::move(v_jobs.front());
+			v_jobs.pop_front();
+			v_running.push_back(job.v_cancelled);
+			lock.unlock();
+			try {
+				job.v_open(job.v_cancelled);
+			} catch (...) {
+			}
+			auto latency = std::chrono::steady_clock::now() - job.v_queued;
+			lock.lock();
+			v_running.erase(std::find(v_running.begin(), v_running.end(), job.v_cancelled));
+			if (*job.v_cancelled) continue;
+			++v_opens;
+			v_latency += latency;
+			v_latency_max = std::max(v_latency_max, latency);
+		}
+	}
+
+public:
+	t_opener_pool(size_t a_threads)
+	{
+		for (size_t i = 0; i < a_threads; ++i) v_threads.emplace_back(&t_opener_pool::f_run, this);
+	}
+	~t_opener_pool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(v_mutex);
+			v_stopping = true;
+			for (auto& x : v_jobs) *x.v_cancelled = true;
+			for (auto& x : v_running) *x = true;
+			v_jobs.clear();
+		}
+		v_condition.notify_all();
+		for (auto& x : v_threads) x.join();
+	}
+	t_cancellation f_submit(std::function<void(const t_cancellation&)>&& a_open)
+	{
+		auto cancelled = std::make_shared<std::atomic<bool>>(false);
+		{
+			std::lock_guard<std::mutex> lock(v_mutex);
+			v_jobs.push_back({cancelled, std::move(a_open), std::chrono::steady_clock::now()});
+			v_depth_max = std::max(v_depth_max, v_jobs.size());
+		}
+		v_condition.notify_one();
+		return cancelled;
+	}
+	// Drops the job if it is still queued, and raises its flag either way.
+	// Only jobs that had not finished count as cancelled.
+	void f_cancel(const t_cancellation& a_cancelled)
+	{
+		std::lock_guard<std::mutex> lock(v_mutex);
+		if (a_cancelled->exchange(true)) return;
+		auto i = std::find_if(v_jobs.begin(), v_jobs.end(), [&](auto& a_x)
+		{
+			return a_x.v_cancelled == a_cancelled;
+		});
+		if (i != v_jobs.end()) {
+			v_jobs.erase(i);
+			++v_cancels;
+		} else if (std::find(v_running.begin(), v_running.end(), a_cancelled) != v_running.end()) {
+			++v_cancels;
+		}
+	}
+	void f_clear()
+	{
+		std::lock_guard<std::mutex> lock(v_mutex);
+		for (auto& x : v_jobs) *x.v_cancelled = true;
+		for (auto& x : v_running) if (!x->exchange(true)) ++v_cancels;
+		v_cancels += v_jobs.size();
+		v_jobs.clear();
+	}
+	size_t f_depth() const
+	{
+		std::lock_guard<std::mutex> lock(v_mutex);
+		return v_jobs.size();
+	}
+	size_t f_depth_max() const
+	{
+		std::lock_guard<std::mutex> lock(v_mutex);
+		return v_depth_max;
+	}
+	size_t f_running() const
+	{
+		std::lock_guard<std::mutex> lock(v_mutex);
+		return v_running.size();
+	}
+	size_t f_opens() const
+	{
+		std::lock_guard<std::mutex> lock(v_mutex);
+		return v_opens;
+	}
+	size_t f_cancels() const
+	{
+		std::lock_guard<std::mutex> lock(v_mutex);
+		return v_cancels;
+	}
+	// Latencies of completed opens, from being queued to being done.
+	std::chrono::steady_clock::duration f_latency_average() const
+	{
+		std::lock_guard<std::mutex> lock(v_mutex);
+		return v_opens > 0 ? v_latency / static_cast<std::chrono::steady_clock::rep>(v_opens) : std::chrono::steady_clock::duration{};
+	}
+	std::chrono::steady_clock::duration f_latency_max() const
+	{
+		std::lock_guard<std::mutex> lock(v_mutex);
+		return v_latency_max;
+	}
+};
+
+#endif
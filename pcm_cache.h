@@ -0,0 +1,146 @@
+#ifndef ALEXAAGENT__PCM_CACHE_H
+#define ALEXAAGENT__PCM_CACHE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Decoded PCM mapped from a cache file.
+class t_pcm_mapping
+{
+	friend class t_pcm_cache;
+
+	void* v_p = MAP_FAILED;
+	size_t v_n = 0;
+
+public:
+	size_t v_channels = 0;
+	size_t v_bytes = 0;
+	size_t v_rate = 0;
+	const char* v_data = nullptr;
+	size_t v_size = 0;
+
+	t_pcm_mapping() = default;
+	t_pcm_mapping(const t_pcm_mapping&) = delete;
+	~t_pcm_mapping()
+	{
+		if (v_p != MAP_FAILED) munmap(v_p, v_n);
+	}
+	t_pcm_mapping& operator=(const t_pcm_mapping&) = delete;
+	explicit operator bool() const
+	{
+		return v_data;
+	}
+};
+
+// Stores decoded PCM in a_directory, one file per source path.
+// An entry is valid only while the source keeps the mtime and size it had when the entry was stored.
+class t_pcm_cache
+{
+	struct t_header
+	{
+		char v_magic[8];
+		int64_t v_seconds;
+		int64_t v_nanoseconds;
+		uint64_t v_size;
+		uint32_t v_channels;
+		uint32_t v_bytes;
+		uint32_t v_rate;
+		uint32_t v_path;
+		uint64_t v_data;
+	};
+
+	static constexpr const char* c_magic = "PCMCACH1";
+
+	std::string v_directory;
+
+	std::string f_file(const std::string& a_path) const
+	{
+		char name[32];
+		std::snprintf(name, sizeof(name), "/%016zx.pcm", std::hash<std::string>()(a_path));
+		return v_directory + name;
+	}
+
+public:
+	struct t_key
+	{
+		int64_t v_seconds;
+		int64_t v_nanoseconds;
+		uint64_t v_size;
+	};
+
+	// Fails for anything that is not a regular file, such as a URL.
+	static bool f_key(const std::string& a_path, t_key& a_key)
+	{
+		struct stat s;
+		if (stat(a_path.c_str(), &s) != 0 || !S_ISREG(s.st_mode)) return false;
+		a_key.v_seconds = s.st_mtim.tv_sec;
+		a_key.v_nanoseconds = s.st_mtim.tv_nsec;
+		a_key.v_size = s.st_size;
+		return true;
+	}
+
+	t_pcm_cache(const std::string& a_directory) : v_directory(a_directory)
+	{
+	}
+	bool f_load(const std::string& a_path, const t_key& a_key, t_pcm_mapping& a_mapping) const
+	{
+		int fd = open(f_file(a_path).c_str(), O_RDONLY);
+		if (fd == -1) return false;
+		struct stat s;
+		void* p = fstat(fd, &s) == 0 && static_cast<size_t>(s.st_size) >= sizeof(t_header) ? mmap(NULL, s.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+		close(fd);
+		if (p == MAP_FAILED) return false;
+		if (a_mapping.v_p != MAP_FAILED) munmap(a_mapping.v_p, a_mapping.v_n);
+		a_mapping.v_p = p;
+		a_mapping.v_n = s.st_size;
+		a_mapping.v_data = nullptr;
+		auto& header = *static_cast<const t_header*>(p);
+		if (std::memcmp(header.v_magic, c_magic, sizeof(header.v_magic)) != 0) return false;
+		if (header.v_seconds != a_key.v_seconds || header.v_nanoseconds != a_key.v_nanoseconds || header.v_size != a_key.v_size) return false;
+		size_t n = a_mapping.v_n - sizeof(t_header);
+		if (header.v_path != a_path.size() || header.v_path > n || header.v_data > n - header.v_path) return false;
+		auto path = static_cast<const char*>(p) + sizeof(t_header);
+		if (!std::equal(a_path.begin(), a_path.end(), path)) return false;
+		a_mapping.v_channels = header.v_channels;
+		a_mapping.v_bytes = header.v_bytes;
+		a_mapping.v_rate = header.v_rate;
+		a_mapping.v_data = path + header.v_path;
+		a_mapping.v_size = header.v_data;
+		return true;
+	}
+	// Writes to a temporary file and renames it, so that a partial entry is never mapped.
+	void f_store(const std::string& a_path, const t_key& a_key, size_t a_channels, size_t a_bytes, size_t a_rate, const char* a_p, size_t a_n) const
+	{
+		t_header header;
+		std::memcpy(header.v_magic, c_magic, sizeof(header.v_magic));
+		header.v_seconds = a_key.v_seconds;
+		header.v_nanoseconds = a_key.v_nanoseconds;
+		header.v_size = a_key.v_size;
+		header.v_channels = a_channels;
+		header.v_bytes = a_bytes;
+		header.v_rate = a_rate;
+		header.v_path = a_path.size();
+		header.v_data = a_n;
+		auto file = f_file(a_path);
+		auto temporary = file + ".tmp";
+		auto fp = std::fopen(temporary.c_str(), "wb");
+		if (!fp) throw std::runtime_error("fopen: " + temporary);
+		bool written = std::fwrite(&header, sizeof(header), 1, fp) == 1 && std::fwrite(a_path.data(), 1, a_path.size(), fp) == a_path.size() && std::fwrite(a_p, 1, a_n, fp) == a_n;
+		if (std::fclose(fp) != 0) written = false;
+		if (!written || std::rename(temporary.c_str(), file.c_str()) != 0) {
+			std::remove(temporary.c_str());
+			throw std::runtime_error("writing: " + file);
+		}
+	}
+};
+
+#endif
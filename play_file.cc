@@ -21,21 +21,22 @@ int main(int argc, char* argv[])
 	std::unique_ptr<std::FILE, decltype(&std::fclose)> fp(std::fopen(argv[1], "r"), std::fclose);
 	if (!fp) throw std::runtime_error("fopen");
 	t_callback_audio_source source(std::bind(std::fread, std::placeholders::_1, 1, std::placeholders::_2, fp.get()));
-	t_audio_decoder decoder(source);
-	t_audio_target target;
+	t_audio_decoder decoder(source, f_al_float32());
+	t_audio_target target(1.0, 0.1);
 	try {
 		decoder([&](size_t a_channels, size_t a_bytes, const char* a_p, size_t a_n, size_t a_rate)
 		{
-			auto queued = target(a_channels, a_bytes, a_p, a_n, a_rate);
+			target(a_channels, a_bytes, a_p, a_n, a_rate);
 			std::fprintf(stderr, "%.3f - %.3f\r", target.f_offset(), target.f_remain());
-			while (queued > 32) {
+			while (target.f_full()) {
 				std::this_thread::sleep_for(std::chrono::duration<double>(target.f_remain() * 0.5));
-				queued = target.f_flush();
+				target.f_flush();
 			}
 		});
 	} catch (std::exception& e) {
 		std::fprintf(stderr, "caught: %s\n", e.what());
 	}
+	target.f_end();
 	while (target.f_flush() > 0) {
 		std::fprintf(stderr, "%.3f - %.3f\r", target.f_offset(), target.f_remain());
 		std::this_thread::sleep_for(std::chrono::duration<double>(target.f_remain() * 0.25));
@@ -1,59 +1,25 @@
 #include <thread>
 
 #include "audio.h"
-#include "tiny_http.h"
+#include "playlist.h"
 
-t_audio_source* f_open(const char* a_url)
+t_audio_source* f_open(t_playlist_resolver& a_playlists, const char* a_url)
 {
 	std::string url = a_url;
-	while (true) {
+	for (size_t i = 0;; ++i) {
 		std::fprintf(stderr, "opening: %s\n", url.c_str());
 		try {
 			return new t_url_audio_source(url.c_str());
 		} catch (std::exception& e) {
+			if (i >= 8) throw;
 			std::fprintf(stderr, "caught: %s\ntrying to resolve...\n", e.what());
-			boost::asio::io_service io;
-			t_http10 http(url);
-			t_audio_source* source = nullptr;
-			http("GET")(io, [&](auto& a_socket)
-			{
-				if (http.v_code != 200) throw std::runtime_error("invalid code");
-				std::smatch match;
-				std::regex content_type{"Content-Type:\\s*\\S+/([^\\s;]+)\\s*;?.*\r"};
-				for (auto& x : http.v_headers) if (std::regex_match(x, match, content_type)) break;
-				if (match.empty()) throw std::runtime_error("no Content-Type found");
-				boost::system::error_code ec;
-				if (match[1] == "x-mpegurl") {
-					std::fprintf(stderr, "found x-mpegurl.\n");
-					boost::asio::read_until(a_socket, http.v_buffer, '\n', ec);
-					if (ec && ec != boost::asio::error::eof) throw boost::system::system_error(ec);
-					std::string line;
-					std::getline(std::istream(&http.v_buffer), line);
-					if (!std::regex_match(line, match, std::regex{"\\s*(https?://\\S+)\\s*\r?"})) throw std::runtime_error("invalid url");
-					url = match[1];
-				} else if (match[1] == "x-scpls") {
-					std::fprintf(stderr, "found x-scpls.\n");
-					boost::asio::read(a_socket, http.v_buffer, ec);
-					if (ec && ec != boost::asio::error::eof) throw boost::system::system_error(ec);
-					auto buffer = std::make_shared<boost::asio::streambuf>();
-					std::ostream stream(buffer.get());
-					stream <<
-					"#EXTM3U\n"
-					"#EXT-X-TARGETDURATION:0\n";
-					std::regex file{"File\\d+\\s*=\\s*(https?://\\S+)\\s*\r?"};
-					std::string line;
-					while (std::getline(std::istream(&http.v_buffer), line))
-						if (std::regex_match(line, match, file)) stream << "#EXTINF:0\n" << match[1] << '\n';
-					stream << "#EXT-X-ENDLIST\n";
-					source = new t_callback_audio_source([buffer](auto a_p, auto a_n)
-					{
-						return buffer->sgetn(reinterpret_cast<char*>(a_p), a_n);
-					});
-				} else {
-					throw std::runtime_error("unknown Content-Type: " + match[1].str());
-				}
-			});
-			if (source) return source;
+			auto playlist = a_playlists(url);
+			if (playlist.v_manifest.empty()) {
+				url = playlist.v_url;
+			} else {
+				std::fprintf(stderr, "found manifest.\n");
+				return f_manifest_audio_source(playlist.v_manifest);
+			}
 		}
 	}
 }
@@ -72,23 +38,26 @@ int main(int argc, char* argv[])
 	});
 	alcMakeContextCurrent(context.get());
 	alGetError();
-	std::unique_ptr<t_audio_source> source(f_open(argv[1]));
-	t_audio_decoder decoder(*source);
-	t_audio_target target;
+	t_playlist_resolver playlists;
+	std::unique_ptr<t_audio_source> source(f_open(playlists, argv[1]));
+	std::fprintf(stderr, "playlists: %zu hits, %zu misses\n", playlists.f_hits(), playlists.f_misses());
+	t_audio_decoder decoder(*source, f_al_float32());
+	t_audio_target target(1.0, 0.1);
 	try {
 		std::fprintf(stderr, "decoding...\n");
 		decoder([&](size_t a_channels, size_t a_bytes, const char* a_p, size_t a_n, size_t a_rate)
 		{
-			auto queued = target(a_channels, a_bytes, a_p, a_n, a_rate);
+			target(a_channels, a_bytes, a_p, a_n, a_rate);
 			std::fprintf(stderr, "%.3f - %.3f\r", target.f_offset(), target.f_remain());
-			while (queued > 32) {
+			while (target.f_full()) {
 				std::this_thread::sleep_for(std::chrono::duration<double>(target.f_remain() * 0.5));
-				queued = target.f_flush();
+				target.f_flush();
 			}
 		});
 	} catch (std::exception& e) {
 		std::fprintf(stderr, "caught: %s\n", e.what());
 	}
+	target.f_end();
 	while (target.f_flush() > 0) {
 		std::fprintf(stderr, "%.3f - %.3f\r", target.f_offset(), target.f_remain());
 		std::this_thread::sleep_for(std::chrono::duration<double>(target.f_remain() * 0.25));
@@ -0,0 +1,297 @@
+#ifndef ALEXAAGENT__PLAYLIST_H
+#define ALEXAAGENT__PLAYLIST_H
+
+#include <atomic>
+#include <chrono>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <regex>
+#include <sstream>
+
+#include "tiny_http.h"
+
+// What a playlist resolves to: either the URL it points to, or an HLS manifest to be opened in place of it.
+struct t_playlist
+{
+	std::string v_url;
+	std::string v_manifest;
+};
+
+// Returns the subtype of an x-mpegurl or x-scpls response, and throws for anything else.
+inline std::string f_playlist_type(const t_http10& a_http)
+{
+	if (a_http.v_code != 200) throw std::runtime_error("invalid code");
+	std::smatch match;
+	std::regex content_type{"Content-Type:\\s*\\S+/([^\\s;]+)\\s*;?.*\r"};
+	for (auto& x : a_http.v_headers) if (std::regex_match(x, match, content_type)) break;
+	if (match.empty()) throw std::runtime_error("no Content-Type found");
+	if (match[1] != "x-mpegurl" && match[1] != "x-scpls") throw std::runtime_error("unknown Content-Type: " + match[1].str());
+	return match[1];
+}
+
+// Parses a playlist line by line as its body streams in.
+// An x-mpegurl resolves to its first URL; an x-scpls is rewritten into an HLS manifest listing its files.
+class t_playlist_parser
+{
+	bool v_m3u;
+	std::regex v_pattern;
+	std::string v_line;
+	std::ostringstream v_manifest;
+	t_playlist v_playlist;
+	bool v_done = false;
+
+	void f_line()
+	{
+		if (!v_line.empty() && v_line.back() == '\r') v_line.pop_back();
+		std::smatch match;
+		if (!v_m3u) {
+			if (std::regex_match(v_line, match, v_pattern)) v_manifest << "#EXTINF:0\n" << match[1] << '\n';
+		} else if (!v_line.empty() && v_line[0] != '#') {
+			if (!std::regex_match(v_line, match, v_pattern)) throw std::runtime_error("invalid url");
+			v_playlist.v_url = match[1];
+			v_done = true;
+		}
+		v_line.clear();
+	}
+
+public:
+	t_playlist_parser(const std::string& a_type) : v_m3u(a_type == "x-mpegurl"), v_pattern(v_m3u ? "\\s*(https?://\\S+)\\s*" : "File\\d+\\s*=\\s*(https?://\\S+)\\s*")
+	{
+		if (!v_m3u) v_manifest <<
+		"#EXTM3U\n"
+		"#EXT-X-TARGETDURATION:0\n";
+	}
+	// Feeds the next part of the body, and returns false once the rest of it is not needed.
+	bool operator()(const char* a_p, size_t a_n)
+	{
+		auto q = a_p + a_n;
+		while (!v_done) {
+			auto i = std::find(a_p, q, '\n');
+			v_line.append(a_p, i);
+			if (i == q) break;
+			a_p = i + 1;
+			f_line();
+		}
+		if (v_line.size() > 65536) throw std::runtime_error("line too long");
+		return !v_done;
+	}
+	// Finishes parsing once the body has ended or the parser has had enough of it.
+	t_playlist f_playlist()
+	{
+		if (!v_done && !v_line.empty()) f_line();
+		if (v_m3u) {
+			if (!v_done) throw std::runtime_error("invalid url");
+		} else {
+			v_manifest << "#EXT-X-ENDLIST\n";
+			v_playlist.v_manifest = v_manifest.str();
+		}
+		return std::move(v_playlist);
+	}
+};
+
+inline t_playlist f_parse_playlist(const std::string& a_type, std::istream& a_body)
+{
+	t_playlist_parser parser(a_type);
+	char buffer[4096];
+	while (a_body.read(buffer, sizeof(buffer)) || a_body.gcount() > 0) if (!parser(buffer, a_body.gcount())) break;
+	return parser.f_playlist();
+}
+
+// Keeps resolved playlists for a_ttl, evicting the least recently used beyond a_capacity.
+// Safe to share between threads.
+class t_playlist_cache
+{
+	struct t_entry
+	{
+		t_playlist v_playlist;
+		std::chrono::steady_clock::time_point v_expires;
+		std::list<std::string>::iterator v_used;
+	};
+
+	mutable std::mutex v_mutex;
+	std::chrono::steady_clock::duration v_ttl;
+	size_t v_capacity;
+	std::list<std::string> v_used;
+	std::map<std::string, t_entry> v_entries;
+	size_t v_expirations = 0;
+	size_t v_evictions = 0;
+
+	void f_erase(std::map<std::string, t_entry>::iterator a_i)
+	{
+		v_used.erase(a_i->second.v_used);
+		v_entries.erase(a_i);
+	}
+
+public:
+	t_playlist_cache(const std::chrono::steady_clock::duration& a_ttl, size_t a_capacity) : v_ttl(a_ttl), v_capacity(a_capacity)
+	{
+	}
+	bool f_find(const std::string& a_url, t_playlist& a_playlist)
+	{
+		std::lock_guard<std::mutex> lock(v_mutex);
+		auto i = v_entries.find(a_url);
+		if (i != v_entries.end() && i->second.v_expires <= std::chrono::steady_clock::now()) {
+			f_erase(i);
+			i = v_entries.end();
+			++v_expirations;
+		}
+		if (i == v_entries.end()) return false;
+		v_used.splice(v_used.begin(), v_used, i->second.v_used);
+		a_playlist = i->second.v_playlist;
+		return true;
+	}
+	void f_store(const std::string& a_url, const t_playlist& a_playlist)
+	{
+		std::lock_guard<std::mutex> lock(v_mutex);
+		auto i = v_entries.find(a_url);
+		if (i != v_entries.end()) f_erase(i);
+		v_used.push_front(a_url);
+		v_entries.emplace(a_url, t_entry{a_playlist, std::chrono::steady_clock::now() + v_ttl, v_used.begin()});
+		while (v_entries.size() > v_capacity) {
+			v_entries.erase(v_used.back());
+			v_used.pop_back();
+			++v_evictions;
+		}
+	}
+	// Forgets a_url, for when what it resolved to turns out not to open any more.
+	void f_forget(const std::string& a_url)
+	{
+		std::lock_guard<std::mutex> lock(v_mutex);
+		auto i = v_entries.find(a_url);
+		if (i != v_entries.end()) f_erase(i);
+	}
+	size_t f_size() const
+	{
+		std::lock_guard<std::mutex> lock(v_mutex);
+		return v_entries.size();
+	}
+	size_t f_expirations() const
+	{
+		std::lock_guard<std::mutex> lock(v_mutex);
+		return v_expirations;
+	}
+	size_t f_evictions() const
+	{
+		std::lock_guard<std::mutex> lock(v_mutex);
+		return v_evictions;
+	}
+};
+
+// Fetches and parses playlists through t_playlist_cache.
+// Hits count resolutions answered from the cache, and misses count playlists fetched.
+// f_cached lookups are left out of both, as they are made for every URL whether it is a playlist or not.
+// With a pool, asynchronous resolutions keep their connections alive through it; the pool has to serve the io_service they run on.
+class t_playlist_resolver
+{
+	struct t_fetch
+	{
+		std::unique_ptr<t_playlist_parser> v_parser;
+		std::exception_ptr v_error;
+	};
+
+	t_playlist_cache v_cache;
+	t_http_pool* v_pool;
+	std::atomic<size_t> v_hits{0};
+	std::atomic<size_t> v_misses{0};
+
+	bool f_find(const std::string& a_url, t_playlist& a_playlist)
+	{
+		if (v_cache.f_find(a_url, a_playlist)) {
+			++v_hits;
+			return true;
+		}
+		++v_misses;
+		return false;
+	}
+
+public:
+	t_playlist_resolver(const std::chrono::steady_clock::duration& a_ttl = std::chrono::minutes(10), size_t a_capacity = 64, t_http_pool* a_pool = nullptr) : v_cache(a_ttl, a_capacity), v_pool(a_pool)
+	{
+	}
+	t_playlist_cache& f_cache()
+	{
+		return v_cache;
+	}
+	size_t f_hits() const
+	{
+		return v_hits;
+	}
+	size_t f_misses() const
+	{
+		return v_misses;
+	}
+	// Looks a_url up without fetching it, for trying what it resolved to before trying a_url itself.
+	bool f_cached(const std::string& a_url, t_playlist& a_playlist)
+	{
+		return v_cache.f_find(a_url, a_playlist);
+	}
+	// Resolves a_url on the calling thread.
+	t_playlist operator()(const std::string& a_url)
+	{
+		t_playlist playlist;
+		if (f_find(a_url, playlist)) return playlist;
+		boost::asio::io_service io;
+		t_http10 http(a_url);
+		std::unique_ptr<t_playlist_parser> parser;
+		http("GET").f_stream(io, [&]
+		{
+			parser.reset(new t_playlist_parser(f_playlist_type(http)));
+			return true;
+		}, [&](auto a_p, auto a_n)
+		{
+			return (*parser)(a_p, a_n);
+		});
+		playlist = parser->f_playlist();
+		v_cache.f_store(a_url, playlist);
+		return playlist;
+	}
+	// Resolves a_url on a_io, and calls back a_done(t_playlist&&, std::exception_ptr) on one of its threads.
+	// A cached playlist is called back immediately.
+	template<typename T_done>
+	void operator()(boost::asio::io_service& a_io, const std::string& a_url, T_done a_done)
+	{
+		t_playlist playlist;
+		if (f_find(a_url, playlist)) return a_done(std::move(playlist), std::exception_ptr());
+		std::shared_ptr<t_http10> http;
+		try {
+			http = std::make_shared<t_http10>(a_url, v_pool);
+		} catch (...) {
+			return a_done(t_playlist(), std::current_exception());
+		}
+		auto fetch = std::make_shared<t_fetch>();
+		(*http)("GET").f_stream(a_io, [http, fetch]
+		{
+			try {
+				fetch->v_parser.reset(new t_playlist_parser(f_playlist_type(*http)));
+				return true;
+			} catch (...) {
+				fetch->v_error = std::current_exception();
+				return false;
+			}
+		}, [fetch](auto a_p, auto a_n)
+		{
+			try {
+				return (*fetch->v_parser)(a_p, a_n);
+			} catch (...) {
+				fetch->v_error = std::current_exception();
+				return false;
+			}
+		}, [this, a_url, a_done, http, fetch](auto a_ec)
+		{
+			if (fetch->v_error) return a_done(t_playlist(), fetch->v_error);
+			if (a_ec) return a_done(t_playlist(), std::make_exception_ptr(boost::system::system_error(a_ec)));
+			t_playlist playlist;
+			try {
+				playlist = fetch->v_parser->f_playlist();
+			} catch (...) {
+				return a_done(t_playlist(), std::current_exception());
+			}
+			v_cache.f_store(a_url, playlist);
+			a_done(std::move(playlist), std::exception_ptr());
+		});
+	}
+};
+
+#endif
@@ -0,0 +1,289 @@
+#ifndef ALEXAAGENT__SAMPLE_H
+#define ALEXAAGENT__SAMPLE_H
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define ALEXAAGENT__SAMPLE_X86
+#include <immintrin.h>
+#endif
+
+template<typename T_0, typename T_1>
+inline T_0 f_sample(T_1 a_x)
+{
+	return a_x;
+}
+
+template<>
+inline int16_t f_sample<int16_t, int32_t>(int32_t a_x)
+{
+	return a_x >> 16;
+}
+
+// Clamped and rounded to nearest, exactly as the SIMD kernels do.
+// The comparisons follow maxps/minps, which return their second operand
+// when either is NaN, so NaN becomes -32768 here too.
+template<>
+inline int16_t f_sample<int16_t, float>(float a_x)
+{
+	auto x = a_x * 32767.0f;
+	x = x > -32768.0f ? x : -32768.0f;
+	return std::lrint(x < 32767.0f ? x : 32767.0f);
+}
+
+template<>
+inline int16_t f_sample<int16_t, double>(double a_x)
+{
+	return f_sample<int16_t>(static_cast<float>(a_x));
+}
+
+template<typename T_0, typename T_1>
+void f_sample_convert(const T_1* a_p, size_t a_n, T_0* a_q)
+{
+	for (size_t i = 0; i < a_n; ++i) a_q[i] = f_sample<T_0>(a_p[i]);
+}
+
+template<typename T_0, typename T_1>
+void f_sample_interleave(const T_1* a_l, const T_1* a_r, size_t a_n, T_0* a_q)
+{
+	for (size_t i = 0; i < a_n; ++i) {
+		*a_q++ = f_sample<T_0>(a_l[i]);
+		*a_q++ = f_sample<T_0>(a_r[i]);
+	}
+}
+
+// Takes the first a_channels of each a_stride-channel frame.
+template<typename T_0, typename T_1>
+void f_sample_pick(const T_1* a_p, size_t a_stride, size_t a_channels, size_t a_n, T_0* a_q)
+{
+	for (size_t i = 0; i < a_n; ++i, a_p += a_stride)
+		for (size_t j = 0; j < a_channels; ++j) *a_q++ = f_sample<T_0>(a_p[j]);
+}
+
+#ifdef ALEXAAGENT__SAMPLE_X86
+struct t_sample_sse2
+{
+	static __m128i f_load(const float* a_p)
+	{
+		auto scale = _mm_set1_ps(32767.0f);
+		auto lo = _mm_set1_ps(-32768.0f);
+		auto hi = _mm_set1_ps(32767.0f);
+		auto x = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(a_p), scale), lo), hi);
+		auto y = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(a_p + 4), scale), lo), hi);
+		return _mm_packs_epi32(_mm_cvtps_epi32(x), _mm_cvtps_epi32(y));
+	}
+	static __m128i f_load(const double* a_p)
+	{
+		float x[8];
+		_mm_storeu_ps(x, _mm_movelh_ps(_mm_cvtpd_ps(_mm_loadu_pd(a_p)), _mm_cvtpd_ps(_mm_loadu_pd(a_p + 2))));
+		_mm_storeu_ps(x + 4, _mm_movelh_ps(_mm_cvtpd_ps(_mm_loadu_pd(a_p + 4)), _mm_cvtpd_ps(_mm_loadu_pd(a_p + 6))));
+		return f_load(x);
+	}
+	static __m128i f_load(const int32_t* a_p)
+	{
+		auto x = _mm_srai_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a_p)), 16);
+		auto y = _mm_srai_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a_p + 4)), 16);
+		return _mm_packs_epi32(x, y);
+	}
+	template<typename T>
+	static void f_convert(const T* a_p, size_t a_n, int16_t* a_q)
+	{
+		size_t i = 0;
+		for (; i + 8 <= a_n; i += 8) _mm_storeu_si128(reinterpret_cast<__m128i*>(a_q + i), f_load(a_p + i));
+		f_sample_convert(a_p + i, a_n - i, a_q + i);
+	}
+	template<typename T>
+	static void f_interleave(const T* a_l, const T* a_r, size_t a_n, int16_t* a_q)
+	{
+		size_t i = 0;
+		for (; i + 8 <= a_n; i += 8) {
+			auto l = f_load(a_l + i);
+			auto r = f_load(a_r + i);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(a_q + i * 2), _mm_unpacklo_epi16(l, r));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(a_q + i * 2 + 8), _mm_unpackhi_epi16(l, r));
+		}
+		f_sample_interleave(a_l + i, a_r + i, a_n - i, a_q + i * 2);
+	}
+	static void f_interleave(const float* a_l, const float* a_r, size_t a_n, float* a_q)
+	{
+		size_t i = 0;
+		for (; i + 4 <= a_n; i += 4) {
+			auto l = _mm_loadu_ps(a_l + i);
+			auto r = _mm_loadu_ps(a_r + i);
+			_mm_storeu_ps(a_q + i * 2, _mm_unpacklo_ps(l, r));
+			_mm_storeu_ps(a_q + i * 2 + 4, _mm_unpackhi_ps(l, r));
+		}
+		f_sample_interleave(a_l + i, a_r + i, a_n - i, a_q + i * 2);
+	}
+};
+
+#define ALEXAAGENT__AVX2 __attribute__((target("avx2")))
+
+struct t_sample_avx2
+{
+	ALEXAAGENT__AVX2 static __m256i f_pack(__m256i a_x, __m256i a_y)
+	{
+		return _mm256_permute4x64_epi64(_mm256_packs_epi32(a_x, a_y), 0xd8);
+	}
+	ALEXAAGENT__AVX2 static __m256i f_round(__m256 a_x)
+	{
+		auto x = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(a_x, _mm256_set1_ps(32767.0f)), _mm256_set1_ps(-32768.0f)), _mm256_set1_ps(32767.0f));
+		return _mm256_cvtps_epi32(x);
+	}
+	ALEXAAGENT__AVX2 static __m256i f_load(const float* a_p)
+	{
+		return f_pack(f_round(_mm256_loadu_ps(a_p)), f_round(_mm256_loadu_ps(a_p + 8)));
+	}
+	ALEXAAGENT__AVX2 static __m256 f_narrow(const double* a_p)
+	{
+		return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm256_cvtpd_ps(_mm256_loadu_pd(a_p))), _mm256_cvtpd_ps(_mm256_loadu_pd(a_p + 4)), 1);
+	}
+	ALEXAAGENT__AVX2 static __m256i f_load(const double* a_p)
+	{
+		return f_pack(f_round(f_narrow(a_p)), f_round(f_narrow(a_p + 8)));
+	}
+	ALEXAAGENT__AVX2 static __m256i f_load(const int32_t* a_p)
+	{
+		auto x = _mm256_srai_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a_p)), 16);
+		auto y = _mm256_srai_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a_p + 8)), 16);
+		return f_pack(x, y);
+	}
+	template<typename T>
+	ALEXAAGENT__AVX2 static void f_convert(const T* a_p, size_t a_n, int16_t* a_q)
+	{
+		size_t i = 0;
+		for (; i + 16 <= a_n; i += 16) _mm256_storeu_si256(reinterpret_cast<__m256i*>(a_q + i), f_load(a_p + i));
+		t_sample_sse2::f_convert(a_p + i, a_n - i, a_q + i);
+	}
+	template<typename T>
+	ALEXAAGENT__AVX2 static void f_interleave(const T* a_l, const T* a_r, size_t a_n, int16_t* a_q)
+	{
+		size_t i = 0;
+		for (; i + 16 <= a_n; i += 16) {
+			auto l = f_load(a_l + i);
+			auto r = f_load(a_r + i);
+			auto lo = _mm256_unpacklo_epi16(l, r);
+			auto hi = _mm256_unpackhi_epi16(l, r);
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(a_q + i * 2), _mm256_permute2x128_si256(lo, hi, 0x20));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(a_q + i * 2 + 16), _mm256_permute2x128_si256(lo, hi, 0x31));
+		}
+		t_sample_sse2::f_interleave(a_l + i, a_r + i, a_n - i, a_q + i * 2);
+	}
+};
+
+#undef ALEXAAGENT__AVX2
+#endif
+
+// A set of conversion kernels chosen once for the running CPU.
+// Non-hot formats (u8, s16) fall through to the scalar templates.
+struct t_sample_kernels
+{
+	static const t_sample_kernels& f_scalar()
+	{
+		static const t_sample_kernels kernels{
+			"scalar",
+			f_sample_convert<int16_t, int32_t>,
+			f_sample_convert<int16_t, float>,
+			f_sample_convert<int16_t, double>,
+			f_sample_interleave<int16_t, int32_t>,
+			f_sample_interleave<int16_t, float>,
+			f_sample_interleave<int16_t, double>,
+			f_sample_interleave<float, float>
+		};
+		return kernels;
+	}
+#ifdef ALEXAAGENT__SAMPLE_X86
+	static const t_sample_kernels& f_sse2()
+	{
+		static const t_sample_kernels kernels{
+			"sse2",
+			t_sample_sse2::f_convert<int32_t>,
+			t_sample_sse2::f_convert<float>,
+			t_sample_sse2::f_convert<double>,
+			t_sample_sse2::f_interleave<int32_t>,
+			t_sample_sse2::f_interleave<float>,
+			t_sample_sse2::f_interleave<double>,
+			t_sample_sse2::f_interleave
+		};
+		return kernels;
+	}
+	static const t_sample_kernels& f_avx2()
+	{
+		static const t_sample_kernels kernels{
+			"avx2",
+			t_sample_avx2::f_convert<int32_t>,
+			t_sample_avx2::f_convert<float>,
+			t_sample_avx2::f_convert<double>,
+			t_sample_avx2::f_interleave<int32_t>,
+			t_sample_avx2::f_interleave<float>,
+			t_sample_avx2::f_interleave<double>,
+			t_sample_sse2::f_interleave
+		};
+		return kernels;
+	}
+	static bool f_avx2_supported()
+	{
+		return __builtin_cpu_supports("avx2");
+	}
+#endif
+	static const t_sample_kernels& f_instance()
+	{
+#ifdef ALEXAAGENT__SAMPLE_X86
+		static const t_sample_kernels& kernels = f_avx2_supported() ? f_avx2() : f_sse2();
+#else
+		static const t_sample_kernels& kernels = f_scalar();
+#endif
+		return kernels;
+	}
+
+	const char* v_name;
+	void (*v_s32)(const int32_t*, size_t, int16_t*);
+	void (*v_flt)(const float*, size_t, int16_t*);
+	void (*v_dbl)(const double*, size_t, int16_t*);
+	void (*v_s32p)(const int32_t*, const int32_t*, size_t, int16_t*);
+	void (*v_fltp)(const float*, const float*, size_t, int16_t*);
+	void (*v_dblp)(const double*, const double*, size_t, int16_t*);
+	void (*v_fltp_flt)(const float*, const float*, size_t, float*);
+
+	template<typename T_0, typename T_1>
+	void operator()(const T_1* a_p, size_t a_n, T_0* a_q) const
+	{
+		f_sample_convert(a_p, a_n, a_q);
+	}
+	void operator()(const int32_t* a_p, size_t a_n, int16_t* a_q) const
+	{
+		v_s32(a_p, a_n, a_q);
+	}
+	void operator()(const float* a_p, size_t a_n, int16_t* a_q) const
+	{
+		v_flt(a_p, a_n, a_q);
+	}
+	void operator()(const double* a_p, size_t a_n, int16_t* a_q) const
+	{
+		v_dbl(a_p, a_n, a_q);
+	}
+	template<typename T_0, typename T_1>
+	void operator()(const T_1* a_l, const T_1* a_r, size_t a_n, T_0* a_q) const
+	{
+		f_sample_interleave(a_l, a_r, a_n, a_q);
+	}
+	void operator()(const int32_t* a_l, const int32_t* a_r, size_t a_n, int16_t* a_q) const
+	{
+		v_s32p(a_l, a_r, a_n, a_q);
+	}
+	void operator()(const float* a_l, const float* a_r, size_t a_n, int16_t* a_q) const
+	{
+		v_fltp(a_l, a_r, a_n, a_q);
+	}
+	void operator()(const double* a_l, const double* a_r, size_t a_n, int16_t* a_q) const
+	{
+		v_dblp(a_l, a_r, a_n, a_q);
+	}
+	void operator()(const float* a_l, const float* a_r, size_t a_n, float* a_q) const
+	{
+		v_fltp_flt(a_l, a_r, a_n, a_q);
+	}
+};
+
+#endif
@@ -2,13 +2,17 @@
 #define ALEXAAGENT__SESSION_H
 
 #include <deque>
+#include <limits>
 #include <ostream>
+#include <regex>
 #include <boost/asio/system_timer.hpp>
 #include <nghttp2/asio_http2_client.h>
 
+#include "allocation.h"
 #include "json.h"
 #include "multipart.h"
 #include "audio.h"
+#include "opener.h"
 #include "scheduler.h"
 
 enum t_severity
@@ -23,21 +27,46 @@ class t_session
 {
 	struct t_channel
 	{
+		struct t_directive
+		{
+			std::function<void()> v_run;
+			// Starts opening ahead, for a directive that can continue the one playing without a gap.
+			std::function<void()> v_prefetch;
+		};
+
 		t_task& v_task;
 		t_audio_target v_target;
-		std::deque<std::function<void()>> v_directives;
+		std::deque<t_directive> v_directives;
 		std::string v_playing;
+		// Where the track being played starts, and where the next one starts once it has been handed over.
+		double v_base = 0.0;
+		double v_next = 0.0;
+		// The boundary is crossed once the buffers queued before it have all been played.
+		size_t v_next_buffers = 0;
+		std::function<void()> v_boundary;
+		bool v_continuing = false;
+		std::chrono::steady_clock::time_point v_ending;
+		std::function<void(double)> v_gapped;
+		// How long before the end of a track of known duration the next one starts opening.
+		double v_lead = 10.0;
+		double v_prefetch_at = std::numeric_limits<double>::infinity();
 
-		t_channel(t_task& a_task) : v_task(a_task)
+		t_channel(t_task& a_task, double a_latency, double a_chunk) : v_task(a_task), v_target(a_latency, a_chunk)
 		{
 		}
 		long f_offset() const
 		{
-			return v_target.f_offset() * 1000.0;
+			return std::max(v_target.f_offset() - v_base, 0.0) * 1000.0;
 		}
-		void f_queue(std::function<void()>&& a_directive)
+		void f_reset()
 		{
-			v_directives.push_back(std::move(a_directive));
+			v_target.f_reset();
+			v_base = 0.0;
+			v_prefetch_at = std::numeric_limits<double>::infinity();
+		}
+		void f_queue(std::function<void()>&& a_directive, std::function<void()>&& a_prefetch = nullptr)
+		{
+			v_directives.push_back({std::move(a_directive), std::move(a_prefetch)});
 			v_task.f_notify();
 		}
 		void f_clear()
@@ -48,28 +77,111 @@ class t_session
 		{
 			while (true) {
 				while (v_directives.empty()) v_task.f_wait();
-				auto directive = std::move(v_directives.front());
+				auto directive = std::move(v_directives.front().v_run);
 				v_directives.pop_front();
 				directive();
 			}
 		}
+		void f_cross()
+		{
+			if (!v_boundary || v_target.f_buffers_played() < v_next_buffers) return;
+			auto boundary = std::move(v_boundary);
+			v_boundary = nullptr;
+			boundary();
+		}
+		// Sets when to prefetch the next directive, for a track of a_seconds (0 if unknown) written after what is queued now.
+		void f_ahead(double a_seconds)
+		{
+			v_prefetch_at = a_seconds > 0.0 ? v_target.f_offset() + v_target.f_remain() + a_seconds - v_lead : std::numeric_limits<double>::infinity();
+		}
+		void f_prefetch()
+		{
+			if (v_target.f_offset() < v_prefetch_at || v_directives.empty() || !v_directives.front().v_prefetch) return;
+			v_prefetch_at = std::numeric_limits<double>::infinity();
+			v_directives.front().v_prefetch();
+		}
+		// Waits a_seconds at most, and no longer than until a pending track boundary is played.
+		void f_wait(double a_seconds)
+		{
+			if (v_boundary) a_seconds = std::min(a_seconds, v_next - v_target.f_offset());
+			// At least a millisecond, so that waiting for a buffer OpenAL has not yet marked processed does not spin.
+			v_task.f_wait(std::chrono::milliseconds(std::max(static_cast<int>(a_seconds * 1000.0), 1)));
+			v_target.f_flush();
+			if (v_ending > std::chrono::steady_clock::time_point() && v_target.f_remain() > 0.0) v_ending = std::chrono::steady_clock::now() + std::chrono::microseconds(static_cast<long>(v_target.f_remain() * 1000000.0));
+			f_cross();
+			f_prefetch();
+		}
+		void f_wait()
+		{
+			if (v_boundary)
+				f_wait(v_next - v_target.f_offset());
+			else
+				v_task.f_wait();
+		}
+		void f_write(size_t a_channels, size_t a_bytes, const char* a_p, size_t a_n, size_t a_rate)
+		{
+			if (v_ending > std::chrono::steady_clock::time_point()) {
+				auto gap = std::chrono::steady_clock::now() - v_ending;
+				v_ending = std::chrono::steady_clock::time_point();
+				if (v_gapped) v_gapped(std::max(std::chrono::duration<double>(gap).count(), 0.0));
+			}
+			v_target(a_channels, a_bytes, a_p, a_n, a_rate);
+			while (v_target.f_full()) f_wait(v_target.f_remain() * 0.5);
+		}
 		void f_loop(t_audio_decoder& a_decoder)
 		{
 			a_decoder([this](size_t a_channels, size_t a_bytes, const char* a_p, size_t a_n, size_t a_rate)
 			{
-				auto queued = v_target(a_channels, a_bytes, a_p, a_n, a_rate);
-				while (queued > 32) {
-					v_task.f_wait(std::chrono::milliseconds(static_cast<int>(v_target.f_remain() * 500.0)));
-					queued = v_target.f_flush();
-				}
+				this->f_write(a_channels, a_bytes, a_p, a_n, a_rate);
 			});
 		}
+		void f_loop(t_audio_decode_ahead& a_ahead)
+		{
+			while (true) {
+				if (auto block = a_ahead.f_front()) {
+					f_write(block->v_channels, block->v_bytes, block->v_data.data(), block->v_data.size(), block->v_rate);
+					a_ahead.f_pop();
+				} else if (a_ahead.f_finished()) {
+					break;
+				} else if (a_ahead.f_arm()) {
+					f_wait();
+				}
+			}
+		}
+		// Waits until the track being decoded is the one being played.
+		void f_settle()
+		{
+			while (v_boundary) f_wait();
+		}
 		void f_flush()
 		{
-			while (v_target.f_flush() > 0) v_task.f_wait(std::chrono::milliseconds(static_cast<int>(v_target.f_remain() * 500.0)));
+			v_target.f_end();
+			while (v_target.f_flush() > 0) f_wait(v_target.f_remain() * 0.5);
+		}
+		// Drains like f_flush, but hands over to a queued directive that can continue right after the last sample.
+		// A directive not prefetched through f_ahead starts opening here, with only what is queued (about v_latency) left to play.
+		bool f_drain()
+		{
+			v_target.f_end();
+			v_ending = std::chrono::steady_clock::now() + std::chrono::microseconds(static_cast<long>(v_target.f_remain() * 1000000.0));
+			while (v_target.f_flush() > 0) {
+				if (!v_boundary && !v_directives.empty() && v_directives.front().v_prefetch) {
+					v_directives.front().v_prefetch();
+					v_next = v_target.f_offset() + v_target.f_remain();
+					v_next_buffers = v_target.f_buffers_queued();
+					v_continuing = true;
+					return true;
+				}
+				f_wait(v_target.f_remain() * 0.5);
+			}
+			// With nothing queued, the silence up to a later Play is idle time, not a gap between tracks.
+			if (v_directives.empty()) v_ending = std::chrono::steady_clock::time_point();
+			return false;
 		}
 		void f_stop()
 		{
+			v_ending = std::chrono::steady_clock::time_point();
+			v_prefetch_at = std::numeric_limits<double>::infinity();
 			if (v_playing.empty()) return;
 			v_target.f_stop();
 			v_task.f_post([](auto)
@@ -111,14 +223,36 @@ public:
 			return static_cast<bool>(v_play);
 		}
 	};
+	typedef std::function<t_audio_source*(const t_opener_pool::t_cancellation&)> t_open;
+	typedef std::function<void(const std::string&, t_open&&, std::exception_ptr)> t_resolved;
+
 private:
 	struct t_parser;
+	// A URL source being opened on another thread.
+	// Cancels the open when the item is dropped, so that discarded items do not keep an opener busy.
+	struct t_opening
+	{
+		t_opener_pool& v_pool;
+		t_opener_pool::t_cancellation v_cancelled;
+		bool v_done = false;
+		std::unique_ptr<t_audio_source> v_source;
+		std::exception_ptr v_error;
+
+		t_opening(t_opener_pool& a_pool) : v_pool(a_pool)
+		{
+		}
+		~t_opening()
+		{
+			if (v_cancelled) v_pool.f_cancel(v_cancelled);
+		}
+	};
 	struct t_attached_audio
 	{
 		t_session& v_session;
 		t_task& v_task;
 		std::map<std::string, t_attached_audio*>::iterator v_i;
-		boost::asio::streambuf v_data;
+		std::deque<std::vector<char>> v_chunks;
+		size_t v_consumed = 0;
 		bool v_finished = false;
 		t_parser* v_parser = nullptr;
 
@@ -132,25 +266,44 @@ private:
 			v_parser->v_content = &t_parser::f_ignore_content;
 			v_parser->v_finish = &t_parser::f_ignore_finish;
 		}
-		t_audio_source* f_open(std::function<void()>&& a_stuttering, std::function<void()>&& a_stuttered)
+		void f_push(const char* a_p, size_t a_n)
+		{
+			if (a_n <= 0) return;
+			v_chunks.emplace_back(a_p, a_p + a_n);
+			v_task.f_notify();
+		}
+		int f_read(uint8_t* a_p, int a_n)
+		{
+			int n = 0;
+			while (n < a_n && !v_chunks.empty()) {
+				auto& chunk = v_chunks.front();
+				size_t m = std::min(chunk.size() - v_consumed, static_cast<size_t>(a_n - n));
+				std::copy_n(chunk.data() + v_consumed, m, a_p + n);
+				n += m;
+				v_consumed += m;
+				if (v_consumed < chunk.size()) break;
+				v_chunks.pop_front();
+				v_consumed = 0;
+			}
+			return n;
+		}
+		t_callback_audio_source* f_open(std::function<void()>&& a_stuttering, std::function<void()>&& a_stuttered)
 		{
 			return new t_callback_audio_source([this, a_stuttering = std::move(a_stuttering), a_stuttered = std::move(a_stuttered)](auto a_p, auto a_n)
 			{
-				if (v_data.size() <= 0) {
+				if (v_chunks.empty()) {
 					if (v_finished) return 0;
 					v_task.f_wait();
-					if (v_data.size() <= 0) {
+					if (v_chunks.empty()) {
 						if (v_finished) return 0;
 						a_stuttering();
-						do v_task.f_wait(); while (v_data.size() <= 0 && !v_finished);
+						do v_task.f_wait(); while (v_chunks.empty() && !v_finished);
 						a_stuttered();
-						if (v_data.size() <= 0) return 0;
+						if (v_chunks.empty()) return 0;
 					}
 				}
-				int n = boost::asio::buffer_copy(boost::asio::buffer(a_p, a_n), v_data.data());
-				v_data.consume(n);
-				return n;
-			});
+				return this->f_read(a_p, a_n);
+			}, v_session.v_attached_buffer);
 		}
 	};
 	struct t_parser
@@ -159,36 +312,78 @@ private:
 		t_multipart<t_parser> v_multipart;
 		void (t_parser::*v_content)(const char*, size_t);
 		void (t_parser::*v_finish)() = &t_parser::f_ignore_finish;
-		boost::asio::streambuf v_metadata;
+		t_json_parser v_json;
+		std::string v_namespace;
+		std::string v_name;
+		bool v_resolved = false;
+		const std::function<void(const picojson::value&)>* v_handler = nullptr;
+		size_t v_allocations = 0;
+		size_t v_bytes = 0;
 		t_attached_audio* v_audio;
 
 		t_parser(t_session& a_session, const std::string& a_boundary) : v_session(a_session), v_multipart(*this, a_boundary)
 		{
+			v_json.v_enter = [this](auto& a_path)
+			{
+				return v_handler || !v_resolved || a_path.size() != 2 || a_path[0] != "directive" || a_path[1] != "payload";
+			};
+			v_json.v_leave = [this](auto& a_path, auto& a_value)
+			{
+				if (v_resolved || a_path.size() != 3 || a_path[0] != "directive" || a_path[1] != "header" || !a_value.template is<std::string>()) return;
+				if (a_path[2] == "namespace")
+					v_namespace = a_value.template get<std::string>();
+				else if (a_path[2] == "name")
+					v_name = a_value.template get<std::string>();
+				else
+					return;
+				if (v_namespace.empty() || v_name.empty()) return;
+				v_resolved = true;
+				if (v_session.v_log) v_session.v_log(e_severity__INFORMATION) << "parser(" << this << ") directive: " << v_namespace + "." << v_name << std::endl;
+				auto i = v_session.v_handlers.find({v_namespace, v_name});
+				if (i != v_session.v_handlers.end()) v_handler = &i->second;
+			};
 		}
 		void f_json_content(const char* a_p, size_t a_n)
 		{
-			v_metadata.sputn(a_p, a_n);
+			t_allocation_scope scope(v_allocations, v_bytes);
+			if (!v_json(a_p, a_n)) {
+				if (v_session.v_log) v_session.v_log(e_severity__ERROR) << "parser(" << this << ") invalid json." << std::endl;
+				v_content = &t_parser::f_ignore_content;
+				v_finish = &t_parser::f_ignore_finish;
+			}
 		}
 		void f_json_finish()
 		{
-			picojson::value directive;
-			picojson::parse(directive, std::istreambuf_iterator<char>(&v_metadata), std::istreambuf_iterator<char>(), nullptr);
-			if (v_session.v_log) v_session.v_log(e_severity__TRACE) << "json: " << directive.serialize(true) << std::endl;
-			auto& header = directive / "directive" / "header";
-			auto ns = header / "namespace"_jss;
-			auto name = header / "name"_jss;
-			if (v_session.v_log) v_session.v_log(e_severity__INFORMATION) << "parser(" << this << ") directive: " << ns + "." << name << std::endl;
-			try {
-				v_session.v_handlers.at({ns, name})(directive);
-			} catch (std::exception& e) {
-				v_session.f_exception_encountered(ns + '.' + name, "UNSUPPORTED_OPERATION", e.what());
+			if (!v_json.f_finish()) {
+				if (v_session.v_log) v_session.v_log(e_severity__ERROR) << "parser(" << this << ") incomplete json." << std::endl;
+				return;
+			}
+			auto& directive = v_json.f_value();
+			if (v_session.v_log) {
+				auto& log = v_session.v_log(e_severity__TRACE) << "json: ";
+				directive.serialize(std::ostream_iterator<char>(log), true);
+				log << std::endl;
 			}
+			if (!v_resolved) {
+				if (v_session.v_log) v_session.v_log(e_severity__ERROR) << "parser(" << this << ") no directive header." << std::endl;
+				return;
+			}
+			{
+				t_allocation_scope scope(v_allocations, v_bytes);
+				try {
+					if (!v_handler) throw std::runtime_error("unsupported directive");
+					(*v_handler)(directive);
+				} catch (std::exception& e) {
+					v_session.f_exception_encountered(v_namespace + '.' + v_name, "UNSUPPORTED_OPERATION", e.what());
+				}
+			}
+#ifndef NDEBUG
+			if (v_session.v_log) v_session.v_log(e_severity__TRACE) << "parser(" << this << ") directive: " << v_namespace << "." << v_name << " allocations: " << v_allocations << " (" << v_bytes << " bytes)" << std::endl;
+#endif
 		}
 		void f_audio_content(const char* a_p, size_t a_n)
 		{
-			boost::asio::buffer_copy(v_audio->v_data.prepare(a_n), boost::asio::buffer(a_p, a_n));
-			v_audio->v_data.commit(a_n);
-			v_audio->v_task.f_notify();
+			v_audio->f_push(a_p, a_n);
 		}
 		void f_audio_finish()
 		{
@@ -210,6 +405,12 @@ private:
 		{
 			if (v_session.v_log) v_session.v_log(e_severity__TRACE) << "parser(" << this << ") part: " << a_type << ", " << a_id << std::endl;
 			if (a_type == "application/json") {
+				v_json.f_reset();
+				v_namespace.clear();
+				v_name.clear();
+				v_resolved = false;
+				v_handler = nullptr;
+				v_allocations = v_bytes = 0;
 				v_content = &t_parser::f_json_content;
 				v_finish = &t_parser::f_json_finish;
 				return;
@@ -232,7 +433,7 @@ private:
 		}
 		void operator()(const uint8_t* a_p, size_t a_n)
 		{
-			for (; a_n > 0; --a_n) v_multipart(*a_p++);
+			v_multipart.f_write(reinterpret_cast<const char*>(a_p), a_n);
 		}
 	};
 	friend struct t_parser;
@@ -258,6 +459,7 @@ private:
 	size_t v_reconnecting_interval = 1;
 	size_t v_message_id = 0;
 	size_t v_dialog_id = 0;
+	std::vector<std::shared_ptr<std::string>> v_event_buffers;
 	std::map<std::pair<std::string, std::string>, std::function<void(const picojson::value&)>> v_handlers{
 		{{"SpeechRecognizer", "ExpectSpeech"}, [this](auto a_directive)
 		{
@@ -324,6 +526,7 @@ private:
 			auto token = stream / "token"_jss;
 			if (v_log) v_log(e_severity__TRACE) << "queuing: " << url << ", " << token << std::endl;
 			std::function<t_audio_source*()> open;
+			std::function<void()> prefetch;
 			if (url.substr(0, 4) == "cid:")
 				open = [this, token, audio = std::make_shared<t_attached_audio>(*this, v_content->v_task, url.substr(4))]
 				{
@@ -333,75 +536,96 @@ private:
 						this->f_player_event("PlaybackStutterStarted");
 					}, [this, token]
 					{
-						this->f_event(this->f_metadata("AudioPlayer", "PlaybackStutterFinished", {
-							{"token", picojson::value(token)},
-							{"offsetInMilliseconds", picojson::value(static_cast<double>(v_content->f_offset()))},
-							{"stutterDurationInMilliseconds", picojson::value(static_cast<double>(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - v_content_stuttering).count()))}
-						}));
+						this->f_event("AudioPlayer", "PlaybackStutterFinished", [&](auto& a_writer)
+						{
+							a_writer.f_key("token").f_value(token);
+							a_writer.f_key("offsetInMilliseconds").f_value(v_content->f_offset());
+							a_writer.f_key("stutterDurationInMilliseconds").f_value(static_cast<long>(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - v_content_stuttering).count()));
+						});
 						v_content_stuttering = std::chrono::steady_clock::time_point();
 					});
 				};
-			else
-				open = [this, url]
+			else {
+				auto opening = std::make_shared<t_opening>(v_openers);
+				prefetch = [this, url, opening]
 				{
-					std::thread([&]
-					{
-						try {
-							v_scheduler.dispatch([&, source = v_open_audio_by_url(url)]
-							{
-								v_content->v_task.f_post([source](auto)
-								{
-									throw source;
-								});
-							});
-						} catch (...) {
-							v_scheduler.dispatch([&, e = std::current_exception()]
-							{
-								v_content->v_task.f_post([e](auto)
-								{
-									std::rethrow_exception(e);
-								});
-							});
-						}
-					}).detach();
-					try {
-						while (true) v_content->v_task.f_wait();
-					} catch (t_audio_source* source) {
-						return source;
-					}
+					if (!opening->v_cancelled) this->f_open_url(opening, url, 0);
 				};
-			v_content->f_queue([this, token, open = std::move(open)]
+				open = [this, prefetch, opening]
+				{
+					prefetch();
+					while (!opening->v_done) v_content->f_wait();
+					if (opening->v_error) std::rethrow_exception(opening->v_error);
+					return opening->v_source.release();
+				};
+			}
+			v_content->f_queue([this, token, open = std::move(open), attached = url.substr(0, 4) == "cid:"]
 			{
-				v_content->v_target.f_reset();
-				v_content->v_playing = token;
-				this->f_player_event("PlaybackStarted");
-				if (v_state_changed) v_state_changed();
+				auto started = [this, token]
+				{
+					v_content->v_playing = token;
+					this->f_player_event("PlaybackStarted");
+					if (v_state_changed) v_state_changed();
+				};
+				if (v_content->v_continuing) {
+					v_content->v_continuing = false;
+					v_content->v_boundary = [this, started]
+					{
+						this->f_player_event("PlaybackFinished");
+						v_content->v_base = v_content->v_next;
+						started();
+					};
+				} else {
+					v_content->f_reset();
+					started();
+				}
 				try {
 					std::unique_ptr<t_audio_source> source(open());
-					t_audio_decoder decoder(*source);
-					v_content->f_loop(decoder);
+					v_content->f_ahead(source->f_duration());
+					if (v_decode_ahead && !attached) {
+						t_audio_decode_ahead ahead(*source, 64, [this]
+						{
+							v_scheduler.dispatch([this]
+							{
+								v_content->v_task.f_notify();
+							});
+						}, f_al_float32(), v_audio_convert ? f_al_frequency() : 0);
+						v_content->f_loop(ahead);
+					} else {
+						t_audio_decoder decoder(*source, f_al_float32(), v_audio_convert ? f_al_frequency() : 0);
+						v_content->f_loop(decoder);
+						if (attached) this->f_log_reads("content", static_cast<t_callback_audio_source&>(*source));
+					}
+					v_content->f_settle();
 					this->f_player_event("PlaybackNearlyFinished");
-					v_content->f_flush();
+					if (v_content->f_drain()) return;
 					this->f_player_event("PlaybackFinished");
 				} catch (nullptr_t) {
+					v_content->v_boundary = nullptr;
 					this->f_player_event("PlaybackStopped");
 				} catch (std::exception& e) {
-					this->f_event(this->f_metadata("AudioPlayer", "PlaybackFailed", {
-						{"token", picojson::value(token)},
-						{"currentPlaybackState", picojson::value(picojson::value::object{
-							{"token", picojson::value(token)},
-							{"offsetInMilliseconds", picojson::value(static_cast<double>(v_content->f_offset()))},
-							{"playerActivity", picojson::value("PLAYING")}
-						})},
-						{"error", picojson::value(picojson::value::object{
-							{"type", picojson::value("MEDIA_ERROR_UNKNOWN")},
-							{"message", picojson::value(e.what())}
-						})}
-					}));
+					if (v_content->v_boundary) {
+						auto boundary = std::move(v_content->v_boundary);
+						v_content->v_boundary = nullptr;
+						boundary();
+					}
+					this->f_event("AudioPlayer", "PlaybackFailed", [&](auto& a_writer)
+					{
+						a_writer.f_key("token").f_value(token);
+						a_writer.f_key("currentPlaybackState").f_begin_object();
+						a_writer.f_key("token").f_value(token);
+						a_writer.f_key("offsetInMilliseconds").f_value(v_content->f_offset());
+						a_writer.f_key("playerActivity").f_value("PLAYING");
+						a_writer.f_end_object();
+						a_writer.f_key("error").f_begin_object();
+						a_writer.f_key("type").f_value("MEDIA_ERROR_UNKNOWN");
+						a_writer.f_key("message").f_value(e.what());
+						a_writer.f_end_object();
+					});
 				}
 				v_content->v_playing.clear();
 				if (v_state_changed) v_state_changed();
-			});
+			}, std::move(prefetch));
 			auto report = stream * "progressReport";
 			if (!report) return;
 			auto delay = *report * "progressReportDelayInMilliseconds";
@@ -452,9 +676,10 @@ private:
 			{
 				auto f = [this, token](const std::string& a_name)
 				{
-					this->f_event(this->f_metadata("SpeechSynthesizer", a_name, {
-						{"token", picojson::value(token)}
-					}));
+					this->f_event("SpeechSynthesizer", a_name, [&](auto& a_writer)
+					{
+						a_writer.f_key("token").f_value(token);
+					});
 				};
 				this->f_dialog_acquire(v_dialog->v_task);
 				v_dialog->v_target.f_reset();
@@ -462,10 +687,11 @@ private:
 				f("SpeechStarted");
 				if (v_state_changed) v_state_changed();
 				try {
-					std::unique_ptr<t_audio_source> source(audio->f_open([] {}, [] {}));
-					t_audio_decoder decoder(*source);
+					std::unique_ptr<t_callback_audio_source> source(audio->f_open([] {}, [] {}));
+					t_audio_decoder decoder(*source, f_al_float32(), v_audio_convert ? f_al_frequency() : 0);
 					v_dialog->f_loop(decoder);
 					v_dialog->f_flush();
+					this->f_log_reads("speak", *source);
 				} catch (nullptr_t) {
 					this->f_exception_encountered("SpeechSynthesizer.Speak", "INTERNAL_ERROR", "Stopped");
 				} catch (std::exception& e) {
@@ -483,14 +709,22 @@ private:
 		}}
 	};
 	std::map<std::string, t_attached_audio*> v_id2audio;
+	size_t v_attached_buffer = 32768;
 	t_channel* v_dialog = nullptr;
 	bool v_dialog_active = false;
 	std::map<std::string, t_alert> v_alerts;
+	std::string v_context_alerts;
+	std::string v_context_speaker;
 	size_t v_alerts_duration = 60;
 	t_channel* v_content = nullptr;
 	bool v_content_can_play_in_background = false;
 	bool v_content_pausing = false;
 	std::chrono::steady_clock::time_point v_content_stuttering;
+	size_t v_content_gaps = 0;
+	double v_content_gap = 0.0;
+	double v_content_gap_max = 0.0;
+	bool v_audio_convert = false;
+	bool v_decode_ahead = false;
 	long v_speaker_volume = 100;
 	bool v_speaker_muted = false;
 	t_task* v_recognizer = nullptr;
@@ -520,77 +754,88 @@ private:
 		});
 		if (v_reconnecting_interval < 256) v_reconnecting_interval *= 2;
 	}
-	picojson::value f_context() const
+	void f_context_playback(t_json_writer& a_writer, const char* a_namespace, const char* a_name, const t_channel& a_channel, const char* a_activity)
 	{
-		picojson::value::array all;
-		picojson::value::array active;
-		for (auto& x : v_alerts) {
-			picojson::value alert(picojson::value::object{
-				{"token", picojson::value(x.first)},
-				{"type", picojson::value(x.second.v_type)},
-				{"scheduledTime", picojson::value(x.second.v_at)}
-			});
-			if (x.second.f_active()) active.push_back(alert);
-			all.push_back(std::move(alert));
+		a_writer.f_begin_object();
+		a_writer.f_key("header").f_begin_object();
+		a_writer.f_key("namespace").f_value(a_namespace);
+		a_writer.f_key("name").f_value(a_name);
+		a_writer.f_end_object();
+		a_writer.f_key("payload").f_begin_object();
+		a_writer.f_key("token").f_value(a_channel.v_playing);
+		a_writer.f_key("offsetInMilliseconds").f_value(a_channel.v_playing.empty() ? 0L : a_channel.f_offset());
+		a_writer.f_key("playerActivity").f_value(a_activity);
+		a_writer.f_end_object();
+		a_writer.f_end_object();
+	}
+	void f_context(t_json_writer& a_writer)
+	{
+		if (v_context_alerts.empty()) {
+			t_json_writer writer(v_context_alerts);
+			writer.f_begin_object();
+			writer.f_key("header").f_begin_object();
+			writer.f_key("namespace").f_value("Alerts");
+			writer.f_key("name").f_value("AlertsState");
+			writer.f_end_object();
+			writer.f_key("payload").f_begin_object();
+			auto alerts = [&](const t_json_key& a_key, bool a_active)
+			{
+				writer.f_key(a_key).f_begin_array();
+				for (auto& x : v_alerts) {
+					if (a_active && !x.second.f_active()) continue;
+					writer.f_begin_object();
+					writer.f_key("token").f_value(x.first);
+					writer.f_key("type").f_value(x.second.v_type);
+					writer.f_key("scheduledTime").f_value(x.second.v_at);
+					writer.f_end_object();
+				}
+				writer.f_end_array();
+			};
+			alerts("allAlerts", false);
+			alerts("activeAlerts", true);
+			writer.f_end_object();
+			writer.f_end_object();
 		}
-		return picojson::value(picojson::value::array{
-			picojson::value(picojson::value::object{
-				{"header", picojson::value(picojson::value::object{
-					{"namespace", picojson::value("AudioPlayer")},
-					{"name", picojson::value("PlaybackState")}
-				})},
-				{"payload", picojson::value(picojson::value::object{
-					{"token", picojson::value(v_content->v_playing)},
-					{"offsetInMilliseconds", picojson::value(static_cast<double>(v_content->v_playing.empty() ? 0 : v_content->f_offset()))},
-					{"playerActivity", picojson::value(v_content->v_playing.empty() ? (v_content->f_offset() > 0 ? "FINISHED" : "IDLE") : v_content_pausing ? "STOPPED" : v_content_stuttering > std::chrono::steady_clock::time_point() ? "BUFFER_UNDERRUN" : "PLAYING")}
-				})}
-			}),
-			picojson::value(picojson::value::object{
-				{"header", picojson::value(picojson::value::object{
-					{"namespace", picojson::value("Alerts")},
-					{"name", picojson::value("AlertsState")}
-				})},
-				{"payload", picojson::value(picojson::value::object{
-					{"allAlerts", picojson::value(all)},
-					{"activeAlerts", picojson::value(active)}
-				})}
-			}),
-			picojson::value(picojson::value::object{
-				{"header", picojson::value(picojson::value::object{
-					{"namespace", picojson::value("Speaker")},
-					{"name", picojson::value("VolumeState")}
-				})},
-				{"payload", picojson::value(picojson::value::object{
-					{"volume", picojson::value(static_cast<double>(v_speaker_volume))},
-					{"muted", picojson::value(v_speaker_muted)}
-				})}
-			}),
-			picojson::value(picojson::value::object{
-				{"header", picojson::value(picojson::value::object{
-					{"namespace", picojson::value("SpeechSynthesizer")},
-					{"name", picojson::value("SpeechState")}
-				})},
-				{"payload", picojson::value(picojson::value::object{
-					{"token", picojson::value(v_dialog->v_playing)},
-					{"offsetInMilliseconds", picojson::value(static_cast<double>(v_dialog->v_playing.empty() ? 0 : v_dialog->f_offset()))},
-					{"playerActivity", picojson::value(v_dialog->v_playing.empty() ? "FINISHED" : "PLAYING")}
-				})}
-			})
-		});
+		if (v_context_speaker.empty()) {
+			t_json_writer writer(v_context_speaker);
+			writer.f_begin_object();
+			writer.f_key("header").f_begin_object();
+			writer.f_key("namespace").f_value("Speaker");
+			writer.f_key("name").f_value("VolumeState");
+			writer.f_end_object();
+			writer.f_key("payload").f_begin_object();
+			writer.f_key("volume").f_value(v_speaker_volume);
+			writer.f_key("muted").f_value(v_speaker_muted);
+			writer.f_end_object();
+			writer.f_end_object();
+		}
+		a_writer.f_begin_array();
+		f_context_playback(a_writer, "AudioPlayer", "PlaybackState", *v_content, v_content->v_playing.empty() ? (v_content->f_offset() > 0 ? "FINISHED" : "IDLE") : v_content_pausing ? "STOPPED" : v_content_stuttering > std::chrono::steady_clock::time_point() ? "BUFFER_UNDERRUN" : "PLAYING");
+		a_writer.f_raw(v_context_alerts);
+		a_writer.f_raw(v_context_speaker);
+		f_context_playback(a_writer, "SpeechSynthesizer", "SpeechState", *v_dialog, v_dialog->v_playing.empty() ? "FINISHED" : "PLAYING");
+		a_writer.f_end_array();
 	}
-	picojson::value f_metadata(const std::string& a_namespace, const std::string& a_name, picojson::value::object&& a_payload)
+	template<typename T_payload>
+	void f_metadata(std::string& a_s, const std::string& a_namespace, const std::string& a_name, T_payload a_payload, bool a_context = false, const std::string& a_dialog_id = std::string())
 	{
 		if (v_log) v_log(e_severity__INFORMATION) << "event: " << a_namespace << "." << a_name << std::endl;
-		return picojson::value(picojson::value::object{
-			{"event", picojson::value(picojson::value::object{
-				{"header", picojson::value(picojson::value::object{
-					{"namespace", picojson::value(a_namespace)},
-					{"name", picojson::value(a_name)},
-					{"messageId", picojson::value("messateId-" + std::to_string(++v_message_id))}
-				})},
-				{"payload", picojson::value(std::move(a_payload))}
-			})}
-		});
+		t_json_writer writer(a_s);
+		writer.f_begin_object();
+		if (a_context) f_context(writer.f_key("context"));
+		writer.f_key("event").f_begin_object();
+		writer.f_key("header").f_begin_object();
+		writer.f_key("namespace").f_value(a_namespace);
+		writer.f_key("name").f_value(a_name);
+		char id[32];
+		writer.f_key("messageId").f_value(id, std::sprintf(id, "messateId-%zu", ++v_message_id));
+		if (!a_dialog_id.empty()) writer.f_key("dialogRequestId").f_value(a_dialog_id);
+		writer.f_end_object();
+		writer.f_key("payload").f_begin_object();
+		a_payload(writer);
+		writer.f_end_object();
+		writer.f_end_object();
+		writer.f_end_object();
 	}
 	void f_setup(const nghttp2::asio_http2::client::response& a_response)
 	{
@@ -630,9 +875,31 @@ private:
 		});
 		return request;
 	}
-	void f_event(const picojson::value& a_metadata)
+	template<typename T_payload>
+	void f_event(const std::string& a_namespace, const std::string& a_name, T_payload a_payload, bool a_context = false)
 	{
-		auto request = f_post(v_boundary_metadata + a_metadata.serialize() + v_boundary_terminator);
+		std::shared_ptr<std::string> buffer;
+		if (v_event_buffers.empty()) {
+			buffer = std::make_shared<std::string>();
+		} else {
+			buffer = std::move(v_event_buffers.back());
+			v_event_buffers.pop_back();
+			buffer->clear();
+		}
+		*buffer += v_boundary_metadata;
+		f_metadata(*buffer, a_namespace, a_name, a_payload, a_context);
+		*buffer += v_boundary_terminator;
+		auto request = f_post([this, buffer, offset = size_t(0)](uint8_t* a_p, size_t a_n, uint32_t* a_flags) mutable
+		{
+			a_n = std::min(a_n, buffer->size() - offset);
+			std::copy_n(buffer->data() + offset, a_n, a_p);
+			offset += a_n;
+			if (offset >= buffer->size()) {
+				*a_flags |= NGHTTP2_DATA_FLAG_EOF;
+				if (v_event_buffers.size() < 8) v_event_buffers.push_back(buffer);
+			}
+			return a_n;
+		});
 		if (request) request->on_close([this, request](auto a_code)
 		{
 			if (v_log) v_log(e_severity__TRACE) << "events POST(" << request << ") on close: " << a_code << std::endl;
@@ -640,25 +907,25 @@ private:
 	}
 	void f_empty_event(const std::string& a_namespace, const std::string& a_name)
 	{
-		f_event(f_metadata(a_namespace, a_name, {}));
+		f_event(a_namespace, a_name, [](auto&) {});
 	}
 	void f_exception_encountered(const std::string& a_directive, const std::string& a_type, const char* a_message)
 	{
-		auto metadata = f_metadata("System", "ExceptionEncountered", {
-			{"unparsedDirective", picojson::value(a_directive)},
-			{"error", picojson::value(picojson::value::object{
-				{"type", picojson::value(a_type)},
-				{"message", picojson::value(a_message)}
-			})}
-		});
-		metadata << "context" & f_context();
-		f_event(metadata);
+		f_event("System", "ExceptionEncountered", [&](auto& a_writer)
+		{
+			a_writer.f_key("unparsedDirective").f_value(a_directive);
+			a_writer.f_key("error").f_begin_object();
+			a_writer.f_key("type").f_value(a_type);
+			a_writer.f_key("message").f_value(a_message);
+			a_writer.f_end_object();
+		}, true);
 	}
 	void f_alerts_event(const std::string& a_name, const std::string& a_token)
 	{
-		f_event(f_metadata("Alerts", a_name, {
-			{"token", picojson::value(a_token)}
-		}));
+		f_event("Alerts", a_name, [&](auto& a_writer)
+		{
+			a_writer.f_key("token").f_value(a_token);
+		});
 	}
 public:
 	void f_alerts_set(const std::string& a_token, const std::string& a_type, const std::string& a_at)
@@ -677,11 +944,13 @@ public:
 			return;
 		}
 		auto i = v_alerts.emplace(a_token, t_alert(a_type, a_at)).first;
+		v_context_alerts.clear();
 		i->second.v_timer.reset(new boost::asio::system_timer(v_scheduler.f_io(), at));
 		i->second.v_timer->async_wait(v_scheduler.wrap([this, i](auto a_ec)
 		{
 			if (i->second.v_type.empty()) {
 				v_alerts.erase(i);
+				v_context_alerts.clear();
 				if (v_alerts_changed) v_alerts_changed();
 				return;
 			}
@@ -689,6 +958,7 @@ public:
 			auto f = [this, i]
 			{
 				i->second.v_play = v_open_sound(i->second.v_type);
+				v_context_alerts.clear();
 				i->second.v_play(v_dialog_active);
 				this->f_alerts_event("AlertStarted", i->first);
 				i->second.v_timer->expires_from_now(std::chrono::seconds(v_alerts_duration));
@@ -696,6 +966,7 @@ public:
 				{
 					this->f_alerts_event("AlertStopped", i->first);
 					v_alerts.erase(i);
+					v_context_alerts.clear();
 					if (v_alerts_changed) v_alerts_changed();
 					if (v_dialog_active) return;
 					for (auto& x : v_alerts) if (x.second.f_active()) return;
@@ -715,13 +986,98 @@ private:
 		auto& alert = v_alerts.at(a_token);
 		if (alert.f_active()) throw std::runtime_error("already active");
 		alert.f_cancel();
+		v_context_alerts.clear();
+	}
+	void f_opened(t_opening& a_opening, t_audio_source* a_source, std::exception_ptr a_error)
+	{
+		a_opening.v_source.reset(a_source);
+		a_opening.v_error = a_error;
+		a_opening.v_done = true;
+		v_content->v_task.f_notify();
+		f_log_openers();
+	}
+	void f_open_failed(t_opening& a_opening, std::exception_ptr a_error)
+	{
+		try {
+			std::rethrow_exception(a_error);
+		} catch (std::exception& e) {
+			if (v_log) v_log(e_severity__ERROR) << "caught: " << e.what() << std::endl;
+		} catch (...) {
+		}
+		f_opened(a_opening, nullptr, std::make_exception_ptr(nullptr));
+	}
+	// Runs a_open on the opener pool, and calls back a_failed on the scheduler unless it succeeds or is cancelled.
+	void f_submit_open(const std::weak_ptr<t_opening>& a_opening, t_open&& a_open, std::function<void(std::exception_ptr)>&& a_failed)
+	{
+		auto p = a_opening.lock();
+		if (!p) return;
+		p->v_cancelled = v_openers.f_submit([this, a_opening, open = std::move(a_open), failed = std::move(a_failed)](auto& a_cancelled)
+		{
+			t_audio_source* source = nullptr;
+			std::exception_ptr error;
+			try {
+				source = open(a_cancelled);
+			} catch (...) {
+				error = std::current_exception();
+			}
+			bool cancelled = *a_cancelled;
+			v_scheduler.dispatch([this, a_opening, failed, source, error, cancelled]
+			{
+				auto p = a_opening.lock();
+				if (!p) {
+					delete source;
+				} else if (error && !cancelled) {
+					failed(error);
+				} else {
+					this->f_opened(*p, source, error);
+				}
+			});
+		});
+	}
+	// Opens a_url on the opener pool.
+	// If that fails, resolves a_url as a playlist on the scheduler without occupying any thread, and opens what it points to.
+	void f_open_url(const std::weak_ptr<t_opening>& a_opening, const std::string& a_url, size_t a_depth)
+	{
+		f_submit_open(a_opening, [this, a_url](auto& a_cancelled)
+		{
+			if (v_log) v_log(e_severity__TRACE) << "opening: " << a_url << std::endl;
+			return v_open_audio_by_url(a_url, a_cancelled);
+		}, [this, a_opening, a_url, a_depth](auto a_error)
+		{
+			auto p = a_opening.lock();
+			if (!v_resolve_audio_url || a_depth >= 8) return this->f_open_failed(*p, a_error);
+			if (v_log) v_log(e_severity__INFORMATION) << "trying to resolve: " << a_url << std::endl;
+			v_resolve_audio_url(a_url, [this, a_opening, a_depth](auto& a_next, auto&& a_open, auto a_error)
+			{
+				auto p = a_opening.lock();
+				if (!p) return;
+				if (!a_next.empty())
+					this->f_open_url(a_opening, a_next, a_depth + 1);
+				else if (a_open)
+					this->f_submit_open(a_opening, std::move(a_open), [this, a_opening](auto a_error)
+					{
+						this->f_open_failed(*a_opening.lock(), a_error);
+					});
+				else
+					this->f_open_failed(*p, a_error);
+			});
+		});
+	}
+	void f_log_openers()
+	{
+		if (v_log) v_log(e_severity__TRACE) << "openers: " << v_openers.f_opens() << " opened in " << std::chrono::duration_cast<std::chrono::milliseconds>(v_openers.f_latency_average()).count() << " ms on average (max " << std::chrono::duration_cast<std::chrono::milliseconds>(v_openers.f_latency_max()).count() << " ms), " << v_openers.f_cancels() << " cancelled, queued: " << v_openers.f_depth() << " (max " << v_openers.f_depth_max() << ")." << std::endl;
+	}
+	void f_log_reads(const char* a_name, const t_callback_audio_source& a_source)
+	{
+		if (v_log) v_log(e_severity__TRACE) << a_name << " reads: " << a_source.f_reads() << " (" << a_source.f_bytes() << " bytes, " << a_source.f_bytes_per_read() << " bytes/read)" << std::endl;
 	}
 	void f_player_event(const std::string& a_name)
 	{
-		f_event(f_metadata("AudioPlayer", a_name, {
-			{"token", picojson::value(v_content->v_playing)},
-			{"offsetInMilliseconds", picojson::value(static_cast<double>(v_content->f_offset()))}
-		}));
+		f_event("AudioPlayer", a_name, [this](auto& a_writer)
+		{
+			a_writer.f_key("token").f_value(v_content->v_playing);
+			a_writer.f_key("offsetInMilliseconds").f_value(v_content->f_offset());
+		});
 	}
 	template<typename T_done>
 	void f_player_background(T_done a_done)
@@ -760,20 +1116,20 @@ private:
 	void f_playback_event(const std::string& a_name)
 	{
 		alSourcePause(v_content->v_target);
-		auto metadata = f_metadata("PlaybackController", a_name, {});
-		metadata << "context" & f_context();
-		f_event(metadata);
+		f_event("PlaybackController", a_name, [](auto&) {}, true);
 	}
 	void f_speaker_event(const std::string& a_name)
 	{
-		f_event(f_metadata("Speaker", a_name, {
-			{"volume", picojson::value(static_cast<double>(v_speaker_volume))},
-			{"muted", picojson::value(v_speaker_muted)}
-		}));
+		f_event("Speaker", a_name, [this](auto& a_writer)
+		{
+			a_writer.f_key("volume").f_value(v_speaker_volume);
+			a_writer.f_key("muted").f_value(v_speaker_muted);
+		});
 	}
 	void f_speaker_apply()
 	{
 		alListenerf(AL_GAIN, v_speaker_muted ? 0.0f : v_speaker_volume / 100.0f);
+		v_context_speaker.clear();
 		if (v_speaker_changed) v_speaker_changed();
 	}
 	void f_dialog_acquire(t_task& a_task)
@@ -860,18 +1216,13 @@ private:
 			if (v_log) v_log(e_severity__INFORMATION) << "recognize started." << std::endl;
 			deque.insert(deque.begin(), v_boundary_audio.begin(), v_boundary_audio.end());
 			{
-				auto metadata = f_metadata("SpeechRecognizer", "Recognize", {
-					{"profile", picojson::value("CLOSE_TALK")},
-					{"format", picojson::value("AUDIO_L16_RATE_16000_CHANNELS_1")}
-				});
-				metadata << "context" & f_context();
-				if (v_expecting_dialog_id.empty()) {
-					metadata / "event" / "header" << "dialogRequestId" & "dialogRequestId-" + std::to_string(++v_dialog_id);
-				} else {
-					metadata / "event" / "header" << "dialogRequestId" & v_expecting_dialog_id;
-					v_expecting_dialog_id.clear();
-				}
-				auto s = metadata.serialize();
+				std::string s;
+				f_metadata(s, "SpeechRecognizer", "Recognize", [](auto& a_writer)
+				{
+					a_writer.f_key("profile").f_value("CLOSE_TALK");
+					a_writer.f_key("format").f_value("AUDIO_L16_RATE_16000_CHANNELS_1");
+				}, true, v_expecting_dialog_id.empty() ? "dialogRequestId-" + std::to_string(++v_dialog_id) : v_expecting_dialog_id);
+				v_expecting_dialog_id.clear();
 				deque.insert(deque.begin(), s.begin(), s.end());
 			}
 			deque.insert(deque.begin(), v_boundary_metadata.begin(), v_boundary_metadata.end());
@@ -927,11 +1278,19 @@ public:
 	std::function<void()> v_options_changed;
 	std::function<void()> v_alerts_changed;
 	std::function<void()> v_speaker_changed;
-	std::function<t_audio_source*(const std::string&)> v_open_audio_by_url = [](auto& a_url)
+	std::function<t_audio_source*(const std::string&, const t_opener_pool::t_cancellation&)> v_open_audio_by_url = [](auto& a_url, auto& a_cancelled)
 	{
-		return new t_url_audio_source(a_url.c_str());
+		return new t_url_audio_source(a_url.c_str(), a_cancelled);
 	};
+	// Called on the scheduler when v_open_audio_by_url fails.
+	// Calls back on the scheduler with either another URL to open, a function opening the resolved source, or an error.
+	std::function<void(const std::string&, t_resolved&&)> v_resolve_audio_url;
 
+private:
+	// Declared last, so that its threads are joined before anything they use is destroyed.
+	t_opener_pool v_openers{2};
+
+public:
 	t_session(t_scheduler& a_scheduler, const std::function<std::ostream&(t_severity)>& a_log, const std::function<std::function<void(bool)>(const std::string&)> a_open_sound) : v_tls(boost::asio::ssl::context::tlsv12), v_scheduler(a_scheduler), v_log(a_log), v_open_sound(a_open_sound)
 	{
 		v_tls.set_default_verify_paths();
@@ -953,7 +1312,7 @@ public:
 		};
 		v_scheduler.f_spawn([this, run](auto& a_task)
 		{
-			t_channel dialog(a_task);
+			t_channel dialog(a_task, 0.5, 0.04);
 			v_dialog = &dialog;
 			run("dialog", [this]
 			{
@@ -962,7 +1321,14 @@ public:
 		});
 		v_scheduler.f_spawn([this, run](auto& a_task)
 		{
-			t_channel content(a_task);
+			t_channel content(a_task, 1.0, 0.1);
+			content.v_gapped = [this](double a_gap)
+			{
+				++v_content_gaps;
+				v_content_gap = a_gap;
+				v_content_gap_max = std::max(v_content_gap_max, a_gap);
+				if (v_log) v_log(e_severity__INFORMATION) << "content gap: " << a_gap * 1000.0 << " ms, max: " << v_content_gap_max * 1000.0 << " ms in " << v_content_gaps << " transitions." << std::endl;
+			};
 			v_content = &content;
 			run("content", [this]
 			{
@@ -979,9 +1345,10 @@ public:
 		});
 		v_scheduler.f_run_every(std::chrono::hours(1), [this](auto)
 		{
-			this->f_event(this->f_metadata("System", "UserInactivityReport", {
-				{"inactiveTimeInSeconds", picojson::value(static_cast<double>(std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now() - v_last_activity).count()))}
-			}));
+			this->f_event("System", "UserInactivityReport", [this](auto& a_writer)
+			{
+				a_writer.f_key("inactiveTimeInSeconds").f_value(static_cast<long>(std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now() - v_last_activity).count()));
+			});
 			return true;
 		});
 	}
@@ -1019,9 +1386,7 @@ public:
 				this->f_setup(a_response);
 				v_online = true;
 				v_reconnecting_interval = 1;
-				auto metadata = this->f_metadata("System", "SynchronizeState", {});
-				metadata << "context" & this->f_context();
-				this->f_event(metadata);
+				this->f_event("System", "SynchronizeState", [](auto&) {}, true);
 				if (v_state_changed) v_state_changed();
 			});
 			request->on_close([this, request](auto a_code)
@@ -1071,7 +1436,9 @@ public:
 	void f_alerts_stop(const std::string& a_token)
 	{
 		auto i = v_alerts.find(a_token);
-		if (i != v_alerts.end() && i->second.f_active()) i->second.f_cancel();
+		if (i == v_alerts.end() || !i->second.f_active()) return;
+		i->second.f_cancel();
+		v_context_alerts.clear();
 	}
 	size_t f_alerts_duration() const
 	{
@@ -1093,6 +1460,51 @@ public:
 		v_content_can_play_in_background = a_value;
 		if (v_options_changed) v_options_changed();
 	}
+	bool f_audio_convert() const
+	{
+		return v_audio_convert;
+	}
+	void f_audio_convert(bool a_value)
+	{
+		if (a_value == v_audio_convert) return;
+		v_audio_convert = a_value;
+		if (v_options_changed) v_options_changed();
+	}
+	size_t f_attached_buffer() const
+	{
+		return v_attached_buffer;
+	}
+	// Clamped to between 4 KiB and 1 MiB.
+	void f_attached_buffer(size_t a_value)
+	{
+		a_value = std::min(std::max(a_value, size_t(4096)), size_t(1 << 20));
+		if (a_value == v_attached_buffer) return;
+		v_attached_buffer = a_value;
+		if (v_options_changed) v_options_changed();
+	}
+	// The silence measured between the last two content tracks, in seconds.
+	double f_content_gap() const
+	{
+		return v_content_gap;
+	}
+	double f_content_gap_max() const
+	{
+		return v_content_gap_max;
+	}
+	size_t f_content_gaps() const
+	{
+		return v_content_gaps;
+	}
+	bool f_decode_ahead() const
+	{
+		return v_decode_ahead;
+	}
+	void f_decode_ahead(bool a_value)
+	{
+		if (a_value == v_decode_ahead) return;
+		v_decode_ahead = a_value;
+		if (v_options_changed) v_options_changed();
+	}
 	bool f_content_playing() const
 	{
 		return !v_content->v_playing.empty();
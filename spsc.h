@@ -0,0 +1,51 @@
+#ifndef ALEXAAGENT__SPSC_H
+#define ALEXAAGENT__SPSC_H
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+// A bounded single-producer/single-consumer ring of reusable slots.
+// The producer fills f_back() and publishes it with f_push(); the consumer reads f_front() and releases it with f_pop().
+template<typename T>
+class t_spsc_ring
+{
+	std::vector<T> v_slots;
+	std::atomic<size_t> v_head{0};
+	char v_padding[64];
+	std::atomic<size_t> v_tail{0};
+
+	size_t f_next(size_t a_i) const
+	{
+		return ++a_i < v_slots.size() ? a_i : 0;
+	}
+
+public:
+	t_spsc_ring(size_t a_n) : v_slots(a_n + 1)
+	{
+	}
+	size_t f_capacity() const
+	{
+		return v_slots.size() - 1;
+	}
+	T* f_back()
+	{
+		size_t tail = v_tail.load(std::memory_order_relaxed);
+		return f_next(tail) == v_head.load(std::memory_order_acquire) ? nullptr : &v_slots[tail];
+	}
+	void f_push()
+	{
+		v_tail.store(f_next(v_tail.load(std::memory_order_relaxed)), std::memory_order_release);
+	}
+	T* f_front()
+	{
+		size_t head = v_head.load(std::memory_order_relaxed);
+		return head == v_tail.load(std::memory_order_acquire) ? nullptr : &v_slots[head];
+	}
+	void f_pop()
+	{
+		v_head.store(f_next(v_head.load(std::memory_order_relaxed)), std::memory_order_release);
+	}
+};
+
+#endif
@@ -0,0 +1,37 @@
+#include <cassert>
+#include <cmath>
+#include <thread>
+
+#include "audio.h"
+
+int main(int argc, char* argv[])
+{
+	auto device = alcOpenDevice(NULL);
+	if (device == NULL) return 77;
+	auto context = alcCreateContext(device, NULL);
+	alcMakeContextCurrent(context);
+	{
+		t_audio_target target(0.2);
+		std::vector<int16_t> samples(800);
+		target(1, 2, reinterpret_cast<const char*>(samples.data()), samples.size() * 2, 8000);
+		ALint state = AL_PLAYING;
+		for (size_t i = 0; state == AL_PLAYING && i < 200; ++i) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+			alGetSourcei(target, AL_SOURCE_STATE, &state);
+		}
+		assert(state == AL_STOPPED);
+		// Underrun: the first buffer has played out and must not be played again.
+		target(1, 2, reinterpret_cast<const char*>(samples.data()), samples.size() * 2, 8000);
+		ALint queued;
+		alGetSourcei(target, AL_BUFFERS_QUEUED, &queued);
+		assert(queued == 1);
+		assert(std::fabs(target.f_offset() - 0.1) < 0.02);
+		assert(target.f_remain() <= 0.1 + 1e-9);
+		assert(target.f_buffers_queued() == 2);
+		assert(target.f_buffers_played() == 1);
+	}
+	alcMakeContextCurrent(NULL);
+	alcDestroyContext(context);
+	alcCloseDevice(device);
+	return 0;
+}
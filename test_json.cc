@@ -0,0 +1,140 @@
+#include <cassert>
+
+#include "json.h"
+
+picojson::value f_parse(const std::string& a_json)
+{
+	picojson::value value;
+	std::string error;
+	picojson::parse(value, a_json.begin(), a_json.end(), &error);
+	assert(error.empty());
+	return value;
+}
+
+int main(int argc, char* argv[])
+{
+	const std::string directive = R"({
+	"directive": {
+		"header": {
+			"namespace": "SpeechSynthesizer",
+			"name": "Speak",
+			"messageId": "0123",
+			"dialogRequestId": "dialogRequestId-1"
+		},
+		"payload": {
+			"url": "cid:foo",
+			"format": "AUDIO_MPEG",
+			"token": "t\"o\\k\/e\n\u00e9\u3042\ud83d\ude00",
+			"volume": -12.5e-1,
+			"numbers": [0, 1, 2.5, 1E3, -0],
+			"flags": [true, false, null],
+			"empty": {},
+			"nested": [[], [{}], {"a": [1, {"b": null}]}]
+		}
+	}
+}
+)";
+	auto expected = f_parse(directive);
+	{
+		char name[16] = "header";
+		assert(!!(expected / "directive" * name));
+		assert(!(expected / "directive" * "head"));
+	}
+	for (size_t i = 0; i <= directive.size(); ++i) {
+		t_json_parser parser;
+		assert(parser(directive.data(), i));
+		assert(parser(directive.data() + i, directive.size() - i));
+		assert(parser.f_finish());
+		assert(parser.f_value() == expected);
+	}
+	{
+		t_json_parser parser;
+		for (char c : directive) assert(parser(&c, 1));
+		assert(parser.f_finish());
+		assert(parser.f_value() == expected);
+		assert(parser.f_value() / "directive" / "payload" / "token"_jss == "t\"o\\k/e\n\xc3\xa9\xe3\x81\x82\xf0\x9f\x98\x80");
+	}
+	{
+		std::vector<std::string> leaves;
+		t_json_parser parser;
+		parser.v_enter = [](auto& a_path)
+		{
+			return a_path.size() != 2 || a_path[1] != "payload";
+		};
+		parser.v_leave = [&](auto& a_path, auto& a_value)
+		{
+			if (a_path.size() == 3 && a_path[1] == "header") leaves.push_back(std::string(a_path[2].v_p, a_path[2].v_n) + '=' + a_value.template get<std::string>());
+		};
+		assert(parser(directive.data(), directive.size()));
+		assert(parser.f_finish());
+		assert(leaves.size() == 4);
+		assert(leaves[0] == "namespace=SpeechSynthesizer");
+		assert(leaves[1] == "name=Speak");
+		auto& x = parser.f_value() / "directive"_jso;
+		assert(x.size() == 1);
+		assert(x.count("header") == 1);
+	}
+	{
+		std::string s = "{";
+		for (size_t i = 0; i < 512; ++i) s += (i > 0 ? ",\"" : "\"") + std::string(64, 'a' + i % 26) + std::to_string(i) + "\":{\"x\":" + std::to_string(i) + '}';
+		s += '}';
+		size_t n = 0;
+		t_json_parser parser;
+		parser.v_leave = [&](auto& a_path, auto& a_value)
+		{
+			if (a_path.size() != 2) return;
+			assert(a_path[0] == std::string(64, 'a' + n % 26) + std::to_string(n));
+			assert(a_path[1] == "x");
+			assert(a_value.template get<double>() == n);
+			++n;
+		};
+		for (size_t i = 0; i < 2; ++i) {
+			parser.f_reset();
+			n = 0;
+			assert(parser(s.data(), s.size()));
+			assert(parser.f_finish());
+			assert(n == 512);
+		}
+	}
+	for (auto x : {"1", "-2.5", "0", "-0.5", "1e10", "1E-2", "2.5e+3", "true", "null", "\"\"", "[]", "{}", " [1, 2] "}) {
+		std::string s = x;
+		t_json_parser parser;
+		assert(parser(s.data(), s.size()));
+		assert(parser.f_finish());
+		assert(parser.f_value() == f_parse(s));
+	}
+	for (auto x : {"", "[", "{\"a\"}", "{\"a\":}", "[1,]", "{,}", "tru", "truee", "nul", "\"\\x\"", "\"\\ud800\"", "\"\\udc00\"", "[1] 2", "\"\x01\"", "{\"a\":1,}", "-", "01", "-01", "1.", "1.e1", "1e", "1e+", "--1", "1-", "1.5.2", "1e1.5"}) {
+		std::string s = x;
+		t_json_parser parser;
+		assert(!parser(s.data(), s.size()) || !parser.f_finish());
+	}
+	{
+		std::string s = "--";
+		t_json_writer writer(s);
+		writer.f_begin_object();
+		writer.f_key("context").f_value(expected / "directive" / "header");
+		writer.f_key("event").f_begin_object();
+		writer.f_key("token").f_value(expected / "directive" / "payload" / "token"_jss);
+		writer.f_key("control").f_value(std::string("\x01\x1f\x7f\b\f\r\t", 7));
+		writer.f_key("offset").f_value(-1234567890L);
+		writer.f_key("volume").f_value(-1.25);
+		writer.f_key("muted").f_value(true);
+		writer.f_key("empty").f_begin_array().f_end_array();
+		writer.f_key("values").f_begin_array().f_value(0L).f_begin_object().f_end_object().f_value("x").f_end_array();
+		writer.f_end_object();
+		writer.f_end_object();
+		s += "--";
+		assert(s.substr(0, 2) == "--" && s.substr(s.size() - 2) == "--");
+		auto value = f_parse(s.substr(2, s.size() - 4));
+		auto& event = value / "event";
+		assert(value / "context" == expected / "directive" / "header");
+		assert(event / "token" == expected / "directive" / "payload" / "token");
+		assert(event / "control"_jss == std::string("\x01\x1f\x7f\b\f\r\t", 7));
+		assert(event / "offset"_jsn == -1234567890.0);
+		assert(event / "volume"_jsn == -1.25);
+		assert(event / "muted"_jsb);
+		assert((event / "empty"_jsa).empty());
+		assert((event / "values"_jsa).size() == 3);
+	}
+	return 0;
+}
@@ -1,6 +1,11 @@
 #include <cassert>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <regex>
 
 #include "multipart.h"
+#include "multipart_summary.h"
 
 struct t_target
 {
@@ -20,11 +25,65 @@ struct t_target
 	}
 };
 
-int main(int argc, char* argv[])
+void f_replay(const std::string& a_path)
+{
+	std::ifstream s(a_path, std::ios::binary);
+	std::string boundary;
+	std::getline(s, boundary);
+	std::string stream{std::istreambuf_iterator<char>(s), std::istreambuf_iterator<char>()};
+	std::vector<std::string> expected;
+	std::ifstream log(a_path + ".log");
+	for (std::string line; std::getline(log, line);) expected.push_back(line);
+	assert(!expected.empty());
+	{
+		t_summary target;
+		t_multipart<t_summary> multipart(target, boundary);
+		for (char c : stream) multipart(c);
+		target.f_close();
+		assert(target.v_log == expected);
+	}
+	for (size_t i = 0; i <= stream.size(); ++i) {
+		t_summary target;
+		t_multipart<t_summary> multipart(target, boundary);
+		multipart.f_write(stream.data(), i);
+		multipart.f_write(stream.data() + i, stream.size() - i);
+		target.f_close();
+		assert(target.v_log == expected);
+	}
+}
+
+std::vector<std::string> f_merge(const std::vector<std::string>& a_log)
+{
+	std::vector<std::string> log;
+	bool content = false;
+	for (auto& x : a_log) {
+		if (x == "content: ") continue;
+		if (x.compare(0, 9, "content: ") != 0) {
+			log.push_back(x);
+			content = false;
+		} else if (content) {
+			log.back() += x.substr(9);
+		} else {
+			log.push_back(x);
+			content = true;
+		}
+	}
+	return log;
+}
+
+std::string f_part(const std::string& a_header, size_t a_limit = 1024)
 {
 	t_target target;
-	t_multipart<t_target> multipart(target, "foo");
-	for (char c :
+	t_multipart<t_target> multipart(target, "foo", a_limit);
+	std::string s = "--foo\r\n" + a_header + "\r\n--foo--\r\n";
+	multipart.f_write(s.data(), s.size());
+	assert(target.v_log.size() >= 2);
+	return target.v_log[1];
+}
+
+int main(int argc, char* argv[])
+{
+	const std::string body =
 "--foo\r\n"
 "Content-Type: application/json; charset=UTF-8\r\n"
 "\r\n"
@@ -43,9 +102,10 @@ int main(int argc, char* argv[])
 "--fooo\r\n"
 "--foo-\r\n"
 "--foo---\r\n"
-"--foo--\r\n"
-	) multipart(c);
-	for (auto& x : target.v_log) std::fprintf(stderr, "%s\n", x.c_str());
+"--foo--\r\n";
+	t_target target;
+	t_multipart<t_target> multipart(target, "foo");
+	for (char c : body) multipart(c);
 	size_t i = 0;
 	assert(target.v_log[i++] == "boundary");
 	assert(target.v_log[i++] == "part: application/json, ");
@@ -68,5 +128,106 @@ int main(int argc, char* argv[])
 	assert(target.v_log[i++] == "content: --");
 	assert(target.v_log[i++] == "content: -");
 	assert(target.v_log[i++] == "boundary");
+	auto expected = f_merge(target.v_log);
+	for (size_t i = 0; i <= body.size(); ++i) {
+		t_target target;
+		t_multipart<t_target> multipart(target, "foo");
+		multipart.f_write(body.data(), i);
+		multipart.f_write(body.data() + i, body.size() - i);
+		assert(f_merge(target.v_log) == expected);
+	}
+	for (size_t i = 1; i <= 8; ++i) {
+		t_target target;
+		t_multipart<t_target> multipart(target, "foo");
+		for (size_t j = 0; j < body.size(); j += i) multipart.f_write(body.data() + j, std::min(i, body.size() - j));
+		assert(f_merge(target.v_log) == expected);
+	}
+	{
+		std::string content;
+		for (size_t i = 0; i < 4096; ++i) content += i % 61 == 0 ? "\r\n--fo" : i % 53 == 0 ? "\r\n--foo-" : std::string(1, static_cast<char>(i * 7));
+		t_target target;
+		t_multipart<t_target> multipart(target, "foo");
+		std::string s = "--foo\r\nContent-Type: application/octet-stream\r\n\r\n" + content + "\r\n--foo--\r\n";
+		multipart.f_write(s.data(), s.size());
+		auto log = f_merge(target.v_log);
+		assert(log.size() == 4);
+		assert(log[2] == "content: " + content);
+	}
+	std::regex re_content_type("content-type:\\s*([\\-0-9a-z]+/[\\-0-9a-z]+).*\r", std::regex::ECMAScript | std::regex::icase);
+	std::regex re_content_id("content-id:\\s*<\\s*(\\S+)\\s*>.*\r", std::regex::ECMAScript | std::regex::icase);
+	std::vector<std::string> lines{
+		"Content-Type: application/json; charset=UTF-8",
+		"content-type:application/octet-stream",
+		"CONTENT-TYPE: \t Text/Plain-X ;q=1",
+		"Content-Type: application/",
+		"Content-Type: /json",
+		"Content-Type : application/json",
+		"Content-Type: application/json\r",
+		"X-Content-Type: application/json",
+		"Content-Typo: application/json",
+		"Content-ID: <bar>",
+		"content-id:<  bar  >",
+		"Content-Id: <a>b>c",
+		"Content-ID: <a b>",
+		"Content-ID: <>",
+		"Content-ID: < >",
+		"Content-ID: bar",
+		"Content-ID: <bar",
+		"Content-ID: <<bar>>",
+		"Content-Disposition: form-data; name=\"metadata\"",
+		"",
+		":",
+		"Content-ID:"
+	};
+	for (auto& line : lines) {
+		std::string type;
+		std::string id;
+		std::smatch match;
+		auto x = line + '\r';
+		if (std::regex_match(x, match, re_content_type))
+			type = match[1].str();
+		else if (std::regex_match(x, match, re_content_id))
+			id = match[1].str();
+		assert(f_part(line.empty() ? "\r\n" : line + "\r\n\r\n") == "part: " + type + ", " + id);
+	}
+	assert(f_part(
+"X-Padding-0: 0123456789\r\n"
+"content-id: <zot>\r\n"
+"X-Padding-1: 0123456789\r\n"
+"CONTENT-TYPE: audio/mpeg\r\n"
+"X-Padding-2: 0123456789\r\n"
+"\r\n"
+	) == "part: audio/mpeg, zot");
+	assert(f_part(
+"Content-ID: <" + std::string(64, 'x') + ">\r\n"
+"Content-Type: application/octet-stream\r\n"
+"\r\n"
+	, 48) == "part: application/octet-stream, ");
+	assert(f_part(
+"Content-ID: <" + std::string(16, 'x') + ">\r\n"
+"\r\n"
+	, 48) == "part: , " + std::string(16, 'x'));
+	{
+		std::string headers;
+		for (size_t i = 0; i < 16; ++i) headers += "X-Header-" + std::to_string(i) + ": some value of a header line\r\n";
+		headers += "Content-Type: application/octet-stream\r\nContent-ID: <audio>\r\n";
+		std::string body;
+		const size_t parts = 1000;
+		for (size_t i = 0; i < parts; ++i) body += "--foo\r\n" + headers + "\r\n0123456789\r\n";
+		body += "--foo--\r\n";
+		t_target target;
+		t_multipart<t_target> multipart(target, "foo");
+		multipart.f_write(body.data(), body.size());
+		auto log = f_merge(target.v_log);
+		assert(log.size() == parts * 3 + 1);
+		assert(log[1] == "part: application/octet-stream, audio");
+	}
+	{
+		auto srcdir = std::getenv("srcdir");
+		std::string directory = std::string(srcdir ? srcdir : ".") + "/corpus/multipart/";
+		std::ifstream index(directory + "index");
+		assert(index);
+		for (std::string name; std::getline(index, name);) f_replay(directory + name);
+	}
 	return 0;
 }
@@ -0,0 +1,75 @@
+#include <cassert>
+#include <future>
+
+#include "opener.h"
+
+int main(int argc, char* argv[])
+{
+	{
+		t_opener_pool pool(1);
+		std::promise<void> entered;
+		std::promise<void> released;
+		auto release = released.get_future().share();
+		auto blocking = pool.f_submit([&](auto& a_cancelled)
+		{
+			entered.set_value();
+			release.wait();
+		});
+		entered.get_future().wait();
+		assert(pool.f_running() == 1);
+		bool ran = false;
+		auto queued = pool.f_submit([&](auto&)
+		{
+			ran = true;
+		});
+		assert(pool.f_depth() == 1);
+		pool.f_cancel(queued);
+		assert(*queued);
+		assert(pool.f_depth() == 0);
+		assert(pool.f_cancels() == 1);
+		std::promise<void> done;
+		pool.f_submit([&](auto&)
+		{
+			done.set_value();
+		});
+		assert(pool.f_depth_max() == 1);
+		released.set_value();
+		done.get_future().wait();
+		assert(!ran);
+		assert(!*blocking);
+		while (pool.f_opens() < 2) std::this_thread::yield();
+		assert(pool.f_latency_max() >= pool.f_latency_average());
+		pool.f_cancel(blocking);
+		assert(pool.f_cancels() == 1);
+	}
+	{
+		t_opener_pool pool(1);
+		std::promise<void> entered;
+		auto cancelled = pool.f_submit([&](auto& a_cancelled)
+		{
+			entered.set_value();
+			while (!*a_cancelled) std::this_thread::yield();
+		});
+		pool.f_submit([&](auto&)
+		{
+			assert(false);
+		});
+		entered.get_future().wait();
+		pool.f_clear();
+		assert(*cancelled);
+		assert(pool.f_depth() == 0);
+		assert(pool.f_cancels() == 2);
+	}
+	std::atomic<bool> stopped{false};
+	{
+		t_opener_pool pool(2);
+		pool.f_submit([&](auto& a_cancelled)
+		{
+			while (!*a_cancelled) std::this_thread::yield();
+			stopped = true;
+		});
+		while (pool.f_running() < 1) std::this_thread::yield();
+	}
+	assert(stopped);
+	return 0;
+}
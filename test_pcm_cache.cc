@@ -0,0 +1,58 @@
+#include <cassert>
+#include <cstdio>
+#include <fstream>
+#include <unistd.h>
+
+#include "pcm_cache.h"
+
+int main(int argc, char* argv[])
+{
+	char directory[] = "/tmp/test_pcm_cache.XXXXXX";
+	if (!mkdtemp(directory)) {
+		std::perror("mkdtemp");
+		return 1;
+	}
+	std::string source = std::string(directory) + "/sound.mp3";
+	std::ofstream(source) << "mp3";
+	t_pcm_cache cache(directory);
+	t_pcm_cache::t_key key;
+	assert(!t_pcm_cache::f_key(directory, key));
+	if (!t_pcm_cache::f_key(source, key)) {
+		std::perror(source.c_str());
+		return 1;
+	}
+	assert(key.v_size == 3);
+	{
+		t_pcm_mapping mapping;
+		assert(!cache.f_load(source, key, mapping));
+		assert(!mapping);
+	}
+	const char pcm[] = {1, 2, 3, 4, 5, 6, 7, 8};
+	cache.f_store(source, key, 2, 2, 44100, pcm, sizeof(pcm));
+	{
+		t_pcm_mapping mapping;
+		assert(cache.f_load(source, key, mapping));
+		assert(mapping);
+		assert(mapping.v_channels == 2);
+		assert(mapping.v_bytes == 2);
+		assert(mapping.v_rate == 44100);
+		assert(mapping.v_size == sizeof(pcm));
+		assert(std::equal(pcm, pcm + sizeof(pcm), mapping.v_data));
+	}
+	{
+		auto stale = key;
+		++stale.v_size;
+		t_pcm_mapping mapping;
+		assert(!cache.f_load(source, stale, mapping));
+	}
+	{
+		t_pcm_mapping mapping;
+		assert(!cache.f_load(source + ".other", key, mapping));
+	}
+	char name[32];
+	std::snprintf(name, sizeof(name), "/%016zx.pcm", std::hash<std::string>()(source));
+	unlink((directory + std::string(name)).c_str());
+	unlink(source.c_str());
+	rmdir(directory);
+	return 0;
+}
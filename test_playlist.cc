@@ -0,0 +1,104 @@
+#include <cassert>
+#include <thread>
+
+#include "playlist.h"
+
+int main(int argc, char* argv[])
+{
+	{
+		std::istringstream body("#EXTM3U\r\n\r\n#EXTINF:-1,Radio\r\nhttp://example.com/stream\r\nhttp://example.com/other\r\n");
+		auto playlist = f_parse_playlist("x-mpegurl", body);
+		assert(playlist.v_url == "http://example.com/stream");
+		assert(playlist.v_manifest.empty());
+	}
+	{
+		std::istringstream body("#EXTM3U\nnot a url\n");
+		try {
+			f_parse_playlist("x-mpegurl", body);
+			assert(false);
+		} catch (std::runtime_error&) {
+		}
+	}
+	{
+		std::istringstream body("[playlist]\r\nFile1=http://example.com/a\r\nTitle1=A\r\nFile2 = https://example.com/b\r\nNumberOfEntries=2\r\n");
+		auto playlist = f_parse_playlist("x-scpls", body);
+		assert(playlist.v_url.empty());
+		assert(playlist.v_manifest ==
+		"#EXTM3U\n"
+		"#EXT-X-TARGETDURATION:0\n"
+		"#EXTINF:0\nhttp://example.com/a\n"
+		"#EXTINF:0\nhttps://example.com/b\n"
+		"#EXT-X-ENDLIST\n");
+	}
+	{
+		std::string body = "#EXTM3U\r\nhttp://example.com/stream\r\nhttp://example.com/other\r\n";
+		t_playlist_parser parser("x-mpegurl");
+		size_t n = 0;
+		while (n < body.size() && parser(&body[n], 1)) ++n;
+		assert(n == body.find("\r\nhttp://example.com/other") + 1);
+		assert(parser.f_playlist().v_url == "http://example.com/stream");
+	}
+	{
+		std::string body = "[playlist]\nFile1=http://example.com/a";
+		t_playlist_parser parser("x-scpls");
+		for (auto& x : body) assert(parser(&x, 1));
+		assert(parser.f_playlist().v_manifest ==
+		"#EXTM3U\n"
+		"#EXT-X-TARGETDURATION:0\n"
+		"#EXTINF:0\nhttp://example.com/a\n"
+		"#EXT-X-ENDLIST\n");
+	}
+	{
+		t_playlist_cache cache(std::chrono::hours(1), 2);
+		t_playlist playlist;
+		assert(!cache.f_find("a", playlist));
+		cache.f_store("a", {"http://a", ""});
+		cache.f_store("b", {"http://b", ""});
+		assert(cache.f_find("a", playlist));
+		assert(playlist.v_url == "http://a");
+		cache.f_store("c", {"", "manifest"});
+		assert(cache.f_size() == 2);
+		assert(cache.f_evictions() == 1);
+		assert(!cache.f_find("b", playlist));
+		assert(cache.f_find("a", playlist));
+		assert(cache.f_find("c", playlist));
+		assert(playlist.v_manifest == "manifest");
+		cache.f_forget("a");
+		assert(!cache.f_find("a", playlist));
+		assert(cache.f_size() == 1);
+	}
+	{
+		t_playlist_cache cache(std::chrono::milliseconds(10), 2);
+		cache.f_store("a", {"http://a", ""});
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		t_playlist playlist;
+		assert(!cache.f_find("a", playlist));
+		assert(cache.f_expirations() == 1);
+		assert(cache.f_size() == 0);
+	}
+	{
+		t_playlist_resolver resolver;
+		resolver.f_cache().f_store("http://example.com/radio.pls", {"", "manifest"});
+		t_playlist playlist;
+		assert(resolver.f_cached("http://example.com/radio.pls", playlist));
+		assert(!resolver.f_cached("http://example.com/radio.mp3", playlist));
+		assert(resolver.f_hits() == 0);
+		assert(resolver.f_misses() == 0);
+		assert(resolver(std::string("http://example.com/radio.pls")).v_manifest == "manifest");
+		boost::asio::io_service io;
+		resolver(io, "http://example.com/radio.pls", [&](auto&& a_playlist, auto a_error)
+		{
+			assert(!a_error);
+			playlist = a_playlist;
+		});
+		assert(playlist.v_manifest == "manifest");
+		assert(resolver.f_hits() == 2);
+		assert(resolver.f_misses() == 0);
+		resolver(io, "invalid", [&](auto&&, auto a_error)
+		{
+			assert(a_error);
+		});
+		assert(resolver.f_misses() == 1);
+	}
+	return 0;
+}
@@ -0,0 +1,99 @@
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "sample.h"
+
+template<typename T_0, typename T_1, typename T_random>
+void f_check(const t_sample_kernels& a_kernels, T_random a_random)
+{
+	auto& scalar = t_sample_kernels::f_scalar();
+	for (size_t n = 0; n < 67; ++n) {
+		std::vector<T_1> l(n);
+		std::vector<T_1> r(n);
+		for (auto& x : l) x = a_random();
+		for (auto& x : r) x = a_random();
+		std::vector<T_0> expected(n * 2);
+		std::vector<T_0> actual(n * 2);
+		scalar(l.data(), n, expected.data());
+		a_kernels(l.data(), n, actual.data());
+		assert(std::equal(expected.begin(), expected.begin() + n, actual.begin()));
+		scalar(l.data(), r.data(), n, expected.data());
+		a_kernels(l.data(), r.data(), n, actual.data());
+		assert(expected == actual);
+	}
+}
+
+template<typename T>
+void f_check_nan(const t_sample_kernels& a_kernels)
+{
+	std::vector<T> p(37, T(0.25));
+	for (size_t i = 0; i < p.size(); i += 5) p[i] = NAN;
+	std::vector<int16_t> q(p.size() * 2);
+	a_kernels(p.data(), p.data(), p.size(), q.data());
+	for (auto x : q) assert(x == -32768 || x == 8192);
+	a_kernels(p.data(), p.size(), q.data());
+	for (size_t i = 0; i < p.size(); ++i) assert(q[i] == (i % 5 == 0 ? -32768 : 8192));
+}
+
+void f_check(const t_sample_kernels& a_kernels)
+{
+	std::fprintf(stderr, "checking: %s\n", a_kernels.v_name);
+	f_check_nan<float>(a_kernels);
+	f_check_nan<double>(a_kernels);
+	std::mt19937 engine;
+	std::uniform_real_distribution<double> real(-1.25, 1.25);
+	std::uniform_int_distribution<int32_t> integer(INT32_MIN, INT32_MAX);
+	f_check<int16_t, float>(a_kernels, [&]
+	{
+		return static_cast<float>(real(engine));
+	});
+	f_check<int16_t, double>(a_kernels, [&]
+	{
+		return real(engine);
+	});
+	f_check<int16_t, int32_t>(a_kernels, [&]
+	{
+		return integer(engine);
+	});
+	f_check<float, float>(a_kernels, [&]
+	{
+		return static_cast<float>(real(engine));
+	});
+}
+
+int main(int argc, char* argv[])
+{
+	assert(f_sample<int16_t>(1.0f) == 32767);
+	assert(f_sample<int16_t>(-1.0f) == -32767);
+	assert(f_sample<int16_t>(2.0f) == 32767);
+	assert(f_sample<int16_t>(-2.0) == -32768);
+	assert(f_sample<int16_t>(0.5f) == 16384);
+	assert(f_sample<int16_t>(NAN) == -32768);
+	assert(f_sample<int16_t>(INT32_MIN) == -32768);
+	assert(f_sample<int16_t>(int32_t(0x12345678)) == 0x1234);
+	{
+		const float l[] = {0.0f, 1.0f, -1.0f};
+		const float r[] = {0.5f, -0.5f, 2.0f};
+		int16_t q[6];
+		t_sample_kernels::f_instance()(l, r, 3, q);
+		const int16_t expected[] = {0, 16384, 32767, -16384, -32767, 32767};
+		assert(std::equal(q, q + 6, expected));
+	}
+	{
+		const int32_t p[] = {1 << 16, 2 << 16, 3 << 16, 4 << 16, 5 << 16, 6 << 16};
+		int16_t q[4];
+		f_sample_pick(p, 3, 2, 2, q);
+		const int16_t expected[] = {1, 2, 4, 5};
+		assert(std::equal(q, q + 4, expected));
+	}
+	f_check(t_sample_kernels::f_scalar());
+#ifdef ALEXAAGENT__SAMPLE_X86
+	f_check(t_sample_kernels::f_sse2());
+	if (t_sample_kernels::f_avx2_supported()) f_check(t_sample_kernels::f_avx2());
+#endif
+	std::fprintf(stderr, "selected: %s\n", t_sample_kernels::f_instance().v_name);
+	return 0;
+}
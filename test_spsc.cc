@@ -0,0 +1,47 @@
+#include <cassert>
+#include <thread>
+
+#include "spsc.h"
+
+int main(int argc, char* argv[])
+{
+	{
+		t_spsc_ring<int> ring(2);
+		assert(ring.f_capacity() == 2);
+		assert(!ring.f_front());
+		*ring.f_back() = 1;
+		ring.f_push();
+		*ring.f_back() = 2;
+		ring.f_push();
+		assert(!ring.f_back());
+		assert(*ring.f_front() == 1);
+		ring.f_pop();
+		assert(ring.f_back());
+		assert(*ring.f_front() == 2);
+		ring.f_pop();
+		assert(!ring.f_front());
+	}
+	{
+		t_spsc_ring<std::vector<size_t>> ring(7);
+		const size_t n = 1000000;
+		std::thread producer([&]
+		{
+			for (size_t i = 0; i < n; ++i) {
+				std::vector<size_t>* p;
+				while (!(p = ring.f_back())) std::this_thread::yield();
+				p->assign(i % 5 + 1, i);
+				ring.f_push();
+			}
+		});
+		for (size_t i = 0; i < n; ++i) {
+			std::vector<size_t>* p;
+			while (!(p = ring.f_front())) std::this_thread::yield();
+			assert(p->size() == i % 5 + 1);
+			for (auto x : *p) assert(x == i);
+			ring.f_pop();
+		}
+		producer.join();
+		assert(!ring.f_front());
+	}
+	return 0;
+}
@@ -1,60 +1,93 @@
 #ifndef ALEXAAGENT__TINY_HTTP_H
 #define ALEXAAGENT__TINY_HTTP_H
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
 #include <iterator>
 #include <map>
-#include <regex>
-#include <sstream>
+#include <memory>
+#include <mutex>
+#include <istream>
+#include <ostream>
+#include <string>
 #include <boost/asio.hpp>
 #include <boost/asio/ssl.hpp>
 
-inline bool f_uri_safe(char a_c)
+// Which bytes go unescaped in a URI component, and the values of hex digits with -1 for anything else.
+struct t_uri_tables
 {
-	switch (a_c) {
-	case '-':
-	case '.':
-	case '_':
-	case '~':
-		return true;
-	default:
-		return std::isalnum(a_c);
+	bool v_safe[256];
+	signed char v_hex[256];
+
+	constexpr t_uri_tables() : v_safe(), v_hex()
+	{
+		for (int c = 0; c < 256; ++c) {
+			v_safe[c] = (c >= '0' && c <= '9') || (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || c == '-' || c == '.' || c == '_' || c == '~';
+			v_hex[c] = c >= '0' && c <= '9' ? c - '0' : c >= 'A' && c <= 'F' ? c - 'A' + 10 : c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+		}
 	}
+};
+
+inline const t_uri_tables& f_uri_tables()
+{
+	static constexpr t_uri_tables tables;
+	return tables;
 }
 
+inline bool f_uri_safe(char a_c)
+{
+	return f_uri_tables().v_safe[static_cast<unsigned char>(a_c)];
+}
+
+// The size f_uri_encode writes for a_first..a_last.
+template<typename T_in>
+size_t f_uri_encoded_size(T_in a_first, T_in a_last)
+{
+	size_t n = 0;
+	for (; a_first != a_last; ++a_first) n += f_uri_safe(*a_first) ? 1 : 3;
+	return n;
+}
+
+// Writes through a_out, which may be a plain char* into a buffer of f_uri_encoded_size, and returns where it ended.
 template<typename T_in, typename T_out>
 T_out f_uri_encode(T_in a_first, T_in a_last, T_out a_out)
 {
-	auto hex = [](int a_x)
-	{
-		return a_x + (a_x < 10 ? '0' : 'A' - 10);
-	};
+	auto& safe = f_uri_tables().v_safe;
 	for (; a_first != a_last; ++a_first) {
 		unsigned char x = *a_first;
-		if (f_uri_safe(x)) {
+		if (safe[x]) {
 			*a_out++ = x;
 		} else {
 			*a_out++ = '%';
-			*a_out++ = hex(x >> 4);
-			*a_out++ = hex(x & 0xf);
+			*a_out++ = "0123456789ABCDEF"[x >> 4];
+			*a_out++ = "0123456789ABCDEF"[x & 0xf];
 		}
 	}
 	return a_out;
 }
 
+// Writes through a_out and returns where it ended; decoding never grows, so a_out may be a_first itself.
+// A '%' that is not followed by two hex digits is kept as it is, along with whatever follows it.
 template<typename T_in, typename T_out>
 T_out f_uri_decode(T_in a_first, T_in a_last, T_out a_out)
 {
-	auto hex = [](int a_x)
-	{
-		return std::isdigit(a_x) ? a_x - '0' : std::toupper(a_x) - 'A' + 10;
-	};
+	auto& hex = f_uri_tables().v_hex;
 	while (a_first != a_last) {
-		unsigned char x = *a_first++;
-		if (x == '%') {
-			if (a_first == a_last) break;
-			x = hex(*a_first++) << 4;
-			if (a_first == a_last) break;
-			x |= hex(*a_first++);
+		char x = *a_first++;
+		if (x == '%' && a_first != a_last) {
+			auto i = a_first;
+			int high = hex[static_cast<unsigned char>(*i)];
+			if (high >= 0 && ++i != a_last) {
+				int low = hex[static_cast<unsigned char>(*i)];
+				if (low >= 0) {
+					x = high << 4 | low;
+					a_first = ++i;
+				}
+			}
 		}
 		*a_out++ = x;
 	}
@@ -63,41 +96,386 @@ T_out f_uri_decode(T_in a_first, T_in a_last, T_out a_out)
 
 inline std::string f_uri_decode(const std::string& a_x)
 {
-	std::stringbuf s;
-	f_uri_decode(a_x.begin(), a_x.end(), std::ostreambuf_iterator<char>(&s));
-	return s.str();
+	std::string s(a_x.size(), '\0');
+	s.resize(f_uri_decode(a_x.begin(), a_x.end(), &s[0]) - &s[0]);
+	return s;
 }
 
 inline std::string f_build_query_string(const std::map<std::string, std::string>& a_values)
 {
-	if (a_values.empty()) return std::string();
-	std::stringbuf s;
-	for (auto i = a_values.begin();;) {
-		s.sputn(i->first.c_str(), i->first.size());
-		s.sputc('=');
-		f_uri_encode(i->second.begin(), i->second.end(), std::ostreambuf_iterator<char>(&s));
-		if (++i == a_values.end()) break;
-		s.sputc('&');
+	size_t n = 0;
+	for (auto& x : a_values) n += x.first.size() + 2 + f_uri_encoded_size(x.second.begin(), x.second.end());
+	std::string s;
+	if (n <= 0) return s;
+	s.reserve(n - 1);
+	for (auto& x : a_values) {
+		if (!s.empty()) s += '&';
+		s.append(x.first);
+		s += '=';
+		f_uri_encode(x.second.begin(), x.second.end(), std::back_inserter(s));
 	}
-	return s.str();
+	return s;
 }
 
+// Calls a_each(key_first, key_last, value_first, value_last) with the still encoded ranges of each field in a_first..a_last.
+// A field without '=' has an empty value, and empty fields are skipped.
+template<typename T_each>
+void f_each_query(const char* a_first, const char* a_last, T_each a_each)
+{
+	while (a_first != a_last) {
+		auto end = std::find(a_first, a_last, '&');
+		if (end != a_first) {
+			auto equal = std::find(a_first, end, '=');
+			a_each(a_first, equal, equal == end ? end : equal + 1, end);
+		}
+		if (end == a_last) break;
+		a_first = end + 1;
+	}
+}
+
+// Decodes the value of the first a_key into a_value, reusing its storage.
+inline bool f_find_query(const std::string& a_query, const char* a_key, std::string& a_value)
+{
+	size_t n = std::strlen(a_key);
+	bool found = false;
+	f_each_query(a_query.data(), a_query.data() + a_query.size(), [&](auto a_key_first, auto a_key_last, auto a_first, auto a_last)
+	{
+		if (found || static_cast<size_t>(a_key_last - a_key_first) != n || !std::equal(a_key_first, a_key_last, a_key)) return;
+		a_value.resize(a_last - a_first);
+		a_value.resize(f_uri_decode(a_first, a_last, &a_value[0]) - &a_value[0]);
+		found = true;
+	});
+	return found;
+}
+
+// Keeps the first value of each key.
 inline std::map<std::string, std::string> f_parse_query_string(const std::string& a_query)
 {
 	std::map<std::string, std::string> values;
-	for (size_t i = 0; ; ++i) {
-		size_t j = a_query.find('=', i);
-		if (j == std::string::npos) break;
-		auto key = a_query.substr(i, j - i);
-		i = a_query.find('&', ++j);
-		if (i == std::string::npos) {
-			values.emplace(key, f_uri_decode(a_query.substr(j)));
+	f_each_query(a_query.data(), a_query.data() + a_query.size(), [&](auto a_key_first, auto a_key_last, auto a_first, auto a_last)
+	{
+		std::string value(a_last - a_first, '\0');
+		value.resize(f_uri_decode(a_first, a_last, &value[0]) - &value[0]);
+		values.emplace(std::string(a_key_first, a_key_last), std::move(value));
+	});
+	return values;
+}
+
+// Splits "http://" or "https://", the authority up to the first '/', '?' or '#', and the rest, into a_host and a_path pointing into a_first..a_last.
+// Fails for other schemes, an empty authority, and any whitespace or control character.
+inline bool f_split_url(const char* a_first, const char* a_last, const char*& a_host, const char*& a_path)
+{
+	if (std::find_if(a_first, a_last, [](unsigned char a_c)
+	{
+		return a_c <= ' ' || a_c == 0x7f;
+	}) != a_last) return false;
+	size_t n = a_last - a_first;
+	if (n > 7 && std::memcmp(a_first, "http://", 7) == 0)
+		a_host = a_first + 7;
+	else if (n > 8 && std::memcmp(a_first, "https://", 8) == 0)
+		a_host = a_first + 8;
+	else
+		return false;
+	a_path = std::find_if(a_host, a_last, [](char a_c)
+	{
+		return a_c == '/' || a_c == '?' || a_c == '#';
+	});
+	return a_path != a_host;
+}
+
+// Frames a response body by Content-Length, by the chunked transfer coding, or by the end of the connection.
+class t_http_body
+{
+	enum t_state
+	{
+		e_data,
+		e_size,
+		e_chunk,
+		e_chunk_end,
+		e_trailer,
+		e_done
+	};
+
+	t_state v_state = e_done;
+	bool v_until_eof = false;
+	size_t v_remain = 0;
+	std::string v_line;
+
+	void f_line()
+	{
+		switch (v_state) {
+		case e_size:
+			{
+				auto i = v_line.find(';');
+				if (i != std::string::npos) v_line.erase(i);
+				char* end;
+				v_remain = std::strtoull(v_line.c_str(), &end, 16);
+				if (end == v_line.c_str() || end[std::strspn(end, " \t")] != '\0') throw std::runtime_error("invalid chunk size");
+				v_state = v_remain > 0 ? e_chunk : e_trailer;
+			}
+			break;
+		case e_chunk_end:
+			if (!v_line.empty()) throw std::runtime_error("invalid chunk");
+			v_state = e_size;
 			break;
+		default:
+			if (v_line.empty()) v_state = e_done;
 		}
-		values.emplace(key, f_uri_decode(a_query.substr(j, i - j)));
 	}
-	return values;
-}
+
+public:
+	// a_length < 0 reads until the end of the connection.
+	void f_reset(bool a_chunked, long long a_length)
+	{
+		v_line.clear();
+		v_until_eof = !a_chunked && a_length < 0;
+		if (a_chunked) {
+			v_state = e_size;
+		} else {
+			v_state = a_length != 0 ? e_data : e_done;
+			v_remain = a_length;
+		}
+	}
+	bool f_done() const
+	{
+		return v_state == e_done;
+	}
+	bool f_until_eof() const
+	{
+		return v_until_eof;
+	}
+	// Consumes what belongs to the body from [a_p, a_p + a_n), passing its data to a_data(const char*, size_t).
+	// Returns how much was consumed, which is less than a_n only once the body is done.
+	template<typename T_data>
+	size_t operator()(const char* a_p, size_t a_n, T_data a_data)
+	{
+		auto p = a_p;
+		auto q = a_p + a_n;
+		while (p < q && v_state != e_done) {
+			if (v_state == e_data || v_state == e_chunk) {
+				size_t n = v_until_eof ? q - p : std::min<size_t>(q - p, v_remain);
+				a_data(p, n);
+				p += n;
+				if (v_until_eof) continue;
+				v_remain -= n;
+				if (v_remain == 0) v_state = v_state == e_chunk ? e_chunk_end : e_done;
+				continue;
+			}
+			auto i = std::find(p, q, '\n');
+			v_line.append(p, i);
+			if (v_line.size() > 4096) throw std::runtime_error("chunk line too long");
+			if (i == q) return a_n;
+			p = i + 1;
+			if (!v_line.empty() && v_line.back() == '\r') v_line.pop_back();
+			f_line();
+			v_line.clear();
+		}
+		return p - a_p;
+	}
+};
+
+// The client TLS context shared by outbound HTTPS connections, set up on first use by f_instance().
+// Sessions are kept per host so that reconnecting resumes one instead of doing a full handshake.
+class t_tls_client
+{
+	struct t_peer
+	{
+		t_tls_client* v_client;
+		std::string v_host;
+	};
+
+	boost::asio::ssl::context v_context{boost::asio::ssl::context::tlsv12};
+	mutable std::mutex v_mutex;
+	std::map<std::string, SSL_SESSION*> v_sessions;
+	size_t v_handshakes = 0;
+	size_t v_resumptions = 0;
+	std::chrono::steady_clock::duration v_handshake{};
+	std::chrono::steady_clock::duration v_handshake_max{};
+
+	static int f_index()
+	{
+		static int index = SSL_get_ex_new_index(0, nullptr, nullptr, nullptr, [](auto, auto a_p, auto, auto, auto, auto)
+		{
+			delete static_cast<t_peer*>(a_p);
+		});
+		return index;
+	}
+	static int f_new_session(SSL* a_ssl, SSL_SESSION* a_session)
+	{
+		auto peer = static_cast<t_peer*>(SSL_get_ex_data(a_ssl, f_index()));
+		if (!peer) return 0;
+		std::lock_guard<std::mutex> lock(peer->v_client->v_mutex);
+		auto& session = peer->v_client->v_sessions[peer->v_host];
+		if (session) SSL_SESSION_free(session);
+		session = a_session;
+		return 1;
+	}
+
+public:
+	static t_tls_client& f_instance()
+	{
+		static t_tls_client instance;
+		return instance;
+	}
+
+	t_tls_client()
+	{
+		v_context.set_default_verify_paths();
+		SSL_CTX_set_session_cache_mode(v_context.native_handle(), SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+		SSL_CTX_sess_set_new_cb(v_context.native_handle(), f_new_session);
+	}
+	t_tls_client(const t_tls_client&) = delete;
+	~t_tls_client()
+	{
+		for (auto& x : v_sessions) SSL_SESSION_free(x.second);
+	}
+	t_tls_client& operator=(const t_tls_client&) = delete;
+	boost::asio::ssl::context& f_context()
+	{
+		return v_context;
+	}
+	// Makes a stream that can be dropped without a close_notify, as HTTP clients routinely do, and still leave its session resumable.
+	std::shared_ptr<boost::asio::ssl::stream<boost::asio::ip::tcp::socket>> f_stream(boost::asio::io_service& a_io)
+	{
+		return {new boost::asio::ssl::stream<boost::asio::ip::tcp::socket>(a_io, v_context), [](auto a_p)
+		{
+			SSL_set_shutdown(a_p->native_handle(), SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
+			delete a_p;
+		}};
+	}
+	// Offers the session kept for a_host, which may have a port, and names a_host for SNI unless it is an address.
+	void f_prepare(SSL* a_ssl, const std::string& a_host, const std::string& a_name)
+	{
+		boost::system::error_code ec;
+		boost::asio::ip::make_address(a_name, ec);
+		if (ec) SSL_set_tlsext_host_name(a_ssl, a_name.c_str());
+		SSL_set_ex_data(a_ssl, f_index(), new t_peer{this, a_host});
+		std::lock_guard<std::mutex> lock(v_mutex);
+		auto i = v_sessions.find(a_host);
+		if (i != v_sessions.end()) SSL_set_session(a_ssl, i->second);
+	}
+	void f_handshaken(SSL* a_ssl, std::chrono::steady_clock::duration a_duration)
+	{
+		std::lock_guard<std::mutex> lock(v_mutex);
+		++v_handshakes;
+		if (SSL_session_reused(a_ssl)) ++v_resumptions;
+		v_handshake += a_duration;
+		v_handshake_max = std::max(v_handshake_max, a_duration);
+	}
+	size_t f_handshakes() const
+	{
+		std::lock_guard<std::mutex> lock(v_mutex);
+		return v_handshakes;
+	}
+	size_t f_resumptions() const
+	{
+		std::lock_guard<std::mutex> lock(v_mutex);
+		return v_resumptions;
+	}
+	std::chrono::steady_clock::duration f_handshake_average() const
+	{
+		std::lock_guard<std::mutex> lock(v_mutex);
+		return v_handshakes > 0 ? v_handshake / static_cast<std::chrono::steady_clock::rep>(v_handshakes) : std::chrono::steady_clock::duration{};
+	}
+	std::chrono::steady_clock::duration f_handshake_max() const
+	{
+		std::lock_guard<std::mutex> lock(v_mutex);
+		return v_handshake_max;
+	}
+};
+
+// Keeps idle HTTP/1.1 connections per scheme and host for t_http10 to reuse.
+// Sockets belong to the io_service they were connected on, so a pool serves a single io_service and has to go before it.
+class t_http_pool
+{
+	std::mutex v_mutex;
+	t_tls_client& v_tls;
+	size_t v_idle;
+	std::multimap<std::string, std::shared_ptr<boost::asio::ip::tcp::socket>> v_tcps;
+	std::multimap<std::string, std::shared_ptr<boost::asio::ssl::stream<boost::asio::ip::tcp::socket>>> v_tlss;
+	std::atomic<size_t> v_connects{0};
+	std::atomic<size_t> v_handshakes{0};
+	std::atomic<size_t> v_reuses{0};
+	std::atomic<size_t> v_retries{0};
+
+	auto& f_sockets(boost::asio::ip::tcp::socket*)
+	{
+		return v_tcps;
+	}
+	auto& f_sockets(boost::asio::ssl::stream<boost::asio::ip::tcp::socket>*)
+	{
+		return v_tlss;
+	}
+
+public:
+	// Keeps at most a_idle connections per scheme and host.
+	t_http_pool(size_t a_idle = 4, t_tls_client& a_tls = t_tls_client::f_instance()) : v_tls(a_tls), v_idle(a_idle)
+	{
+	}
+	t_tls_client& f_tls()
+	{
+		return v_tls;
+	}
+	template<typename T_socket>
+	std::shared_ptr<T_socket> f_acquire(const std::string& a_key)
+	{
+		std::lock_guard<std::mutex> lock(v_mutex);
+		auto& sockets = f_sockets(static_cast<T_socket*>(nullptr));
+		auto i = sockets.find(a_key);
+		if (i == sockets.end()) return nullptr;
+		auto socket = std::move(i->second);
+		sockets.erase(i);
+		++v_reuses;
+		return socket;
+	}
+	template<typename T_socket>
+	void f_release(const std::string& a_key, const std::shared_ptr<T_socket>& a_socket)
+	{
+		std::lock_guard<std::mutex> lock(v_mutex);
+		auto& sockets = f_sockets(static_cast<T_socket*>(nullptr));
+		if (sockets.count(a_key) < v_idle) sockets.emplace(a_key, a_socket);
+	}
+	void f_clear()
+	{
+		std::lock_guard<std::mutex> lock(v_mutex);
+		v_tcps.clear();
+		v_tlss.clear();
+	}
+	void f_connected()
+	{
+		++v_connects;
+	}
+	void f_handshaken()
+	{
+		++v_handshakes;
+	}
+	// A reused connection turned out to be closed by the peer and the request was sent again on a new one.
+	void f_retried()
+	{
+		++v_retries;
+	}
+	size_t f_idle()
+	{
+		std::lock_guard<std::mutex> lock(v_mutex);
+		return v_tcps.size() + v_tlss.size();
+	}
+	size_t f_connects() const
+	{
+		return v_connects;
+	}
+	size_t f_handshakes() const
+	{
+		return v_handshakes;
+	}
+	size_t f_reuses() const
+	{
+		return v_reuses;
+	}
+	size_t f_retries() const
+	{
+		return v_retries;
+	}
+};
 
 struct t_http10
 {
@@ -109,25 +487,298 @@ struct t_http10
 	size_t v_code;
 	std::string v_message;
 	std::vector<std::string> v_headers;
+	t_http_pool* v_pool;
+	std::string v_body;
+	bool v_keep_alive = false;
+
+private:
+	t_http_body v_decoder;
+	std::function<bool(const char*, size_t)> v_data;
+	bool v_stopped = false;
+
+	std::string f_key() const
+	{
+		return v_service + "://" + v_host;
+	}
+	boost::asio::ip::tcp::resolver::query f_query() const
+	{
+		auto i = v_host.rfind(':');
+		if (i == std::string::npos || v_host.find(']', i) != std::string::npos) return {v_host, v_service};
+		return {v_host.substr(0, i), v_host.substr(i + 1)};
+	}
+	t_tls_client& f_tls()
+	{
+		return v_pool ? v_pool->f_tls() : t_tls_client::f_instance();
+	}
+	void f_prepare(boost::asio::ssl::stream<boost::asio::ip::tcp::socket>& a_socket)
+	{
+		f_tls().f_prepare(a_socket.native_handle(), v_host, f_query().host_name());
+	}
+	// Finds a_name case-insensitively and sets a_value to its trimmed value.
+	bool f_header(const std::string& a_name, std::string& a_value) const
+	{
+		auto equal = [](char a_x, char a_y)
+		{
+			return std::tolower(a_x) == std::tolower(a_y);
+		};
+		for (auto& x : v_headers) {
+			if (x.size() <= a_name.size() || x[a_name.size()] != ':' || !std::equal(a_name.begin(), a_name.end(), x.begin(), equal)) continue;
+			auto i = x.find_first_not_of(" \t", a_name.size() + 1);
+			auto j = x.find_last_not_of(" \t\r");
+			a_value = i == std::string::npos || j < i ? std::string() : x.substr(i, j + 1 - i);
+			std::transform(a_value.begin(), a_value.end(), a_value.begin(), [](char a_c)
+			{
+				return std::tolower(a_c);
+			});
+			return true;
+		}
+		return false;
+	}
+	std::string f_take_request()
+	{
+		auto data = v_buffer.data();
+		std::string request(boost::asio::buffers_begin(data), boost::asio::buffers_end(data));
+		v_buffer.consume(v_buffer.size());
+		return request;
+	}
+	void f_clear_response()
+	{
+		v_buffer.consume(v_buffer.size());
+		v_http.clear();
+		v_code = 0;
+		v_message.clear();
+		v_headers.clear();
+		v_body.clear();
+		v_keep_alive = false;
+		v_stopped = false;
+	}
+	// Parses the status line and the headers in v_buffer, and sets up the body framing they describe.
+	void f_head()
+	{
+		std::istream stream(&v_buffer);
+		std::getline(stream >> v_http >> v_code, v_message);
+		std::string header;
+		while (std::getline(stream, header) && header != "\r") v_headers.push_back(header);
+		std::string value;
+		bool chunked = f_header("Transfer-Encoding", value) && value.find("chunked") != std::string::npos;
+		long long length = -1;
+		if (v_code < 200 || v_code == 204 || v_code == 304)
+			length = 0;
+		else if (!chunked && f_header("Content-Length", value))
+			length = std::stoll(value);
+		v_decoder.f_reset(chunked, length);
+		v_keep_alive = v_http == "HTTP/1.1" && !v_decoder.f_until_eof() && !(f_header("Connection", value) && value == "close");
+	}
+	void f_body()
+	{
+		auto data = v_buffer.data();
+		v_buffer.consume(v_decoder(boost::asio::buffer_cast<const char*>(data), boost::asio::buffer_size(data), [this](auto a_p, auto a_n)
+		{
+			if (v_stopped || v_data(a_p, a_n)) return;
+			v_stopped = true;
+			v_keep_alive = false;
+		}));
+	}
+	bool f_finished() const
+	{
+		return v_decoder.f_done() || v_stopped;
+	}
+	static bool f_eof(const boost::system::error_code& a_ec)
+	{
+		return a_ec == boost::asio::error::eof || a_ec == boost::asio::ssl::error::stream_truncated;
+	}
+	template<typename T_socket>
+	void f_release(const std::shared_ptr<T_socket>& a_socket)
+	{
+		if (v_pool && v_keep_alive) v_pool->f_release(f_key(), a_socket);
+	}
+	std::shared_ptr<boost::asio::ip::tcp::socket> f_connect(boost::asio::io_service& a_io, boost::asio::ip::tcp::socket*)
+	{
+		boost::asio::ip::tcp::resolver resolver(a_io);
+		auto socket = std::make_shared<boost::asio::ip::tcp::socket>(a_io);
+		boost::asio::connect(*socket, resolver.resolve(f_query()));
+		if (v_pool) v_pool->f_connected();
+		return socket;
+	}
+	std::shared_ptr<boost::asio::ssl::stream<boost::asio::ip::tcp::socket>> f_connect(boost::asio::io_service& a_io, boost::asio::ssl::stream<boost::asio::ip::tcp::socket>*)
+	{
+		boost::asio::ip::tcp::resolver resolver(a_io);
+		auto socket = f_tls().f_stream(a_io);
+		boost::asio::connect(socket->lowest_layer(), resolver.resolve(f_query()));
+		if (v_pool) v_pool->f_connected();
+		f_prepare(*socket);
+		auto t0 = std::chrono::steady_clock::now();
+		socket->handshake(boost::asio::ssl::stream_base::client);
+		f_tls().f_handshaken(socket->native_handle(), std::chrono::steady_clock::now() - t0);
+		if (v_pool) v_pool->f_handshaken();
+		return socket;
+	}
+	template<typename T_done>
+	void f_connect(boost::asio::io_service& a_io, boost::asio::ip::tcp::socket*, T_done a_done)
+	{
+		auto resolver = std::make_shared<boost::asio::ip::tcp::resolver>(a_io);
+		resolver->async_resolve(f_query(), [this, &a_io, resolver, a_done](auto a_ec, auto a_i) mutable
+		{
+			if (a_ec) return a_done(a_ec, std::shared_ptr<boost::asio::ip::tcp::socket>());
+			auto socket = std::make_shared<boost::asio::ip::tcp::socket>(a_io);
+			boost::asio::async_connect(*socket, a_i, [this, a_done, socket](auto a_ec, auto) mutable
+			{
+				if (!a_ec && v_pool) v_pool->f_connected();
+				a_done(a_ec, socket);
+			});
+		});
+	}
+	template<typename T_done>
+	void f_connect(boost::asio::io_service& a_io, boost::asio::ssl::stream<boost::asio::ip::tcp::socket>*, T_done a_done)
+	{
+		auto resolver = std::make_shared<boost::asio::ip::tcp::resolver>(a_io);
+		resolver->async_resolve(f_query(), [this, &a_io, resolver, a_done](auto a_ec, auto a_i) mutable
+		{
+			if (a_ec) return a_done(a_ec, std::shared_ptr<boost::asio::ssl::stream<boost::asio::ip::tcp::socket>>());
+			auto socket = this->f_tls().f_stream(a_io);
+			boost::asio::async_connect(socket->lowest_layer(), a_i, [this, a_done, socket](auto a_ec, auto) mutable
+			{
+				if (a_ec) return a_done(a_ec, socket);
+				if (v_pool) v_pool->f_connected();
+				this->f_prepare(*socket);
+				socket->async_handshake(boost::asio::ssl::stream_base::client, [this, a_done, socket, t0 = std::chrono::steady_clock::now()](auto a_ec) mutable
+				{
+					if (!a_ec) {
+						this->f_tls().f_handshaken(socket->native_handle(), std::chrono::steady_clock::now() - t0);
+						if (v_pool) v_pool->f_handshaken();
+					}
+					a_done(a_ec, socket);
+				});
+			});
+		});
+	}
+	template<typename T_socket, typename T_head>
+	void f_exchange(T_socket& a_socket, const std::string& a_request, T_head& a_head)
+	{
+		f_clear_response();
+		boost::asio::write(a_socket, boost::asio::buffer(a_request));
+		boost::asio::read_until(a_socket, v_buffer, "\r\n\r\n");
+		f_head();
+		if (!a_head()) throw boost::system::system_error(boost::asio::error::operation_aborted);
+		while (true) {
+			f_body();
+			if (f_finished()) break;
+			boost::system::error_code ec;
+			v_buffer.commit(a_socket.read_some(v_buffer.prepare(4096), ec));
+			if (!ec) continue;
+			if (!f_eof(ec) || !v_decoder.f_until_eof()) throw boost::system::system_error(ec);
+			f_body();
+			break;
+		}
+	}
+	template<typename T_socket, typename T_head>
+	void f_request(boost::asio::io_service& a_io, const std::string& a_request, T_head& a_head)
+	{
+		auto socket = v_pool ? v_pool->template f_acquire<T_socket>(f_key()) : nullptr;
+		if (socket) {
+			try {
+				f_exchange(*socket, a_request, a_head);
+				return f_release(socket);
+			} catch (boost::system::system_error&) {
+				if (!v_http.empty()) throw;
+				v_pool->f_retried();
+			}
+		}
+		socket = f_connect(a_io, static_cast<T_socket*>(nullptr));
+		f_exchange(*socket, a_request, a_head);
+		f_release(socket);
+	}
+	template<typename T_socket, typename T_done>
+	void f_read(const std::shared_ptr<T_socket>& a_socket, T_done a_done)
+	{
+		try {
+			f_body();
+		} catch (std::exception&) {
+			return a_done(boost::system::errc::make_error_code(boost::system::errc::protocol_error));
+		}
+		if (f_finished()) {
+			f_release(a_socket);
+			return a_done(boost::system::error_code());
+		}
+		a_socket->async_read_some(v_buffer.prepare(4096), [this, a_socket, a_done](auto a_ec, auto a_n) mutable
+		{
+			v_buffer.commit(a_n);
+			if (!a_ec) return this->f_read(a_socket, a_done);
+			if (!f_eof(a_ec) || !v_decoder.f_until_eof()) return a_done(a_ec);
+			try {
+				this->f_body();
+			} catch (std::exception&) {
+				return a_done(boost::system::errc::make_error_code(boost::system::errc::protocol_error));
+			}
+			a_done(boost::system::error_code());
+		});
+	}
+	template<typename T_socket, typename T_head, typename T_done>
+	void f_exchange(const std::shared_ptr<T_socket>& a_socket, const std::shared_ptr<std::string>& a_request, T_head a_head, T_done a_done)
+	{
+		f_clear_response();
+		boost::asio::async_write(*a_socket, boost::asio::buffer(*a_request), [this, a_socket, a_request, a_head, a_done](auto a_ec, auto) mutable
+		{
+			if (a_ec) return a_done(a_ec);
+			boost::asio::async_read_until(*a_socket, v_buffer, "\r\n\r\n", [this, a_socket, a_head, a_done](auto a_ec, auto) mutable
+			{
+				if (a_ec) return a_done(a_ec);
+				try {
+					this->f_head();
+				} catch (std::exception&) {
+					return a_done(boost::system::errc::make_error_code(boost::system::errc::protocol_error));
+				}
+				if (!a_head()) return a_done(boost::system::error_code(boost::asio::error::operation_aborted));
+				this->f_read(a_socket, a_done);
+			});
+		});
+	}
+	template<typename T_socket, typename T_head, typename T_done>
+	void f_request(boost::asio::io_service& a_io, const std::shared_ptr<std::string>& a_request, T_head a_head, T_done a_done)
+	{
+		auto connect = [this, &a_io, a_request, a_head, a_done]
+		{
+			this->f_connect(a_io, static_cast<T_socket*>(nullptr), [this, a_request, a_head, a_done](auto a_ec, auto a_socket) mutable
+			{
+				if (a_ec) return a_done(a_ec);
+				this->f_exchange(a_socket, a_request, a_head, a_done);
+			});
+		};
+		auto socket = v_pool ? v_pool->template f_acquire<T_socket>(f_key()) : nullptr;
+		if (!socket) return connect();
+		f_exchange(socket, a_request, a_head, [this, a_done, connect](auto a_ec) mutable
+		{
+			if (!a_ec || !v_http.empty()) return a_done(a_ec);
+			v_pool->f_retried();
+			connect();
+		});
+	}
 
-	t_http10(const std::string& a_url)
+public:
+	// With a_pool, requests are sent as HTTP/1.1 and have to be made with f_stream or f_fetch.
+	t_http10(const std::string& a_url, t_http_pool* a_pool = nullptr) : v_pool(a_pool)
 	{
-		std::smatch match;
-		if (!std::regex_match(a_url, match, std::regex{"(https?)://([^/]+)(.*)"})) throw std::runtime_error("invalid url");
-		v_service = match[1];
-		v_host = match[2];
-		v_path = match[3];
+		auto first = a_url.data();
+		auto last = first + a_url.size();
+		const char* host;
+		const char* path;
+		if (!f_split_url(first, last, host, path)) throw std::runtime_error("invalid url");
+		v_service.assign(first, host - 3);
+		v_host.assign(host, path);
+		last = std::find(path, last, '#');
+		if (path != last && *path == '?') v_path = '/';
+		v_path.append(path, last);
 	}
 	t_http10& operator()(const char* a_method)
 	{
-		std::ostream(&v_buffer) << a_method << ' ' << (v_path.empty() ? "/" : v_path) << " HTTP/1.0\r\n"
-		"Host: " << v_host << "\r\n\r\n";
+		std::ostream(&v_buffer) << a_method << ' ' << (v_path.empty() ? "/" : v_path) << (v_pool ? " HTTP/1.1\r\n" : " HTTP/1.0\r\n")
+		<< "Host: " << v_host << "\r\n\r\n";
 		return *this;
 	}
 	t_http10& operator()(const char* a_method, const std::string& a_data, const char* a_content_type = "application/octet-stream")
 	{
-		std::ostream(&v_buffer) << a_method << ' ' << (v_path.empty() ? "/" : v_path) << " HTTP/1.0\r\n"
-		"Host: " << v_host << "\r\n"
+		std::ostream(&v_buffer) << a_method << ' ' << (v_path.empty() ? "/" : v_path) << (v_pool ? " HTTP/1.1\r\n" : " HTTP/1.0\r\n")
+		<< "Host: " << v_host << "\r\n"
 		"Content-Length: " << a_data.size() << "\r\n"
 		"Content-Type: " << a_content_type << "\r\n"
 		"Cache-Control: no-cache\r\n\r\n" << a_data;
@@ -137,6 +788,59 @@ struct t_http10
 	{
 		return (*this)(a_method, f_build_query_string(a_query), "application/x-www-form-urlencoded");
 	}
+	// Sends the request and passes the response body to a_data(const char*, size_t) as it comes in, decoding Content-Length or chunked framing.
+	// a_head() is called once the headers are in, and returning false from it aborts the response.
+	// Returning false from a_data stops reading the body, which leaves the connection unusable for another request.
+	// With a pool, the connection is taken from and given back to it whenever the response allows keep-alive;
+	// a reused connection that the peer has closed meanwhile is replaced once.
+	template<typename T_head, typename T_data>
+	void f_stream(boost::asio::io_service& a_io, T_head a_head, T_data a_data)
+	{
+		v_data = a_data;
+		auto request = f_take_request();
+		if (v_service == "http")
+			f_request<boost::asio::ip::tcp::socket>(a_io, request, a_head);
+		else
+			f_request<boost::asio::ssl::stream<boost::asio::ip::tcp::socket>>(a_io, request, a_head);
+	}
+	// The same as above on a_io, calling back a_done(boost::system::error_code) on one of its threads.
+	// An exception out of a_data fails the response with protocol_error.
+	template<typename T_head, typename T_data, typename T_done>
+	void f_stream(boost::asio::io_service& a_io, T_head a_head, T_data a_data, T_done a_done)
+	{
+		v_data = a_data;
+		auto request = std::make_shared<std::string>(f_take_request());
+		if (v_service == "http")
+			f_request<boost::asio::ip::tcp::socket>(a_io, request, a_head, a_done);
+		else
+			f_request<boost::asio::ssl::stream<boost::asio::ip::tcp::socket>>(a_io, request, a_head, a_done);
+	}
+	// Streams the whole response body into v_body.
+	template<typename T_head>
+	void f_fetch(boost::asio::io_service& a_io, T_head a_head)
+	{
+		f_stream(a_io, a_head, [this](auto a_p, auto a_n)
+		{
+			v_body.append(a_p, a_n);
+			return true;
+		});
+	}
+	void f_fetch(boost::asio::io_service& a_io)
+	{
+		f_fetch(a_io, []
+		{
+			return true;
+		});
+	}
+	template<typename T_head, typename T_done>
+	void f_fetch(boost::asio::io_service& a_io, T_head a_head, T_done a_done)
+	{
+		f_stream(a_io, a_head, [this](auto a_p, auto a_n)
+		{
+			v_body.append(a_p, a_n);
+			return true;
+		}, a_done);
+	}
 	template<typename T_receive>
 	void operator()(boost::asio::io_service& a_io, T_receive a_receive)
 	{
@@ -152,17 +856,18 @@ struct t_http10
 			a_receive(a_socket);
 		};
 		boost::asio::ip::tcp::resolver resolver(a_io);
-		auto endpoint = resolver.resolve({v_host, v_service});
+		auto endpoint = resolver.resolve(f_query());
 		if (v_service == "http") {
 			auto socket = std::make_shared<boost::asio::ip::tcp::socket>(a_io);
 			boost::asio::connect(*socket, endpoint);
 			send(*socket);
 		} else {
-			auto tls = std::make_shared<boost::asio::ssl::context>(boost::asio::ssl::context::tlsv12);
-			tls->set_default_verify_paths();
-			auto socket = std::make_shared<boost::asio::ssl::stream<boost::asio::ip::tcp::socket>>(a_io, *tls);
+			auto socket = f_tls().f_stream(a_io);
 			boost::asio::connect(socket->lowest_layer(), endpoint);
+			f_prepare(*socket);
+			auto t0 = std::chrono::steady_clock::now();
 			socket->handshake(boost::asio::ssl::stream_base::client);
+			f_tls().f_handshaken(socket->native_handle(), std::chrono::steady_clock::now() - t0);
 			send(*socket);
 		}
 	}
@@ -194,7 +899,7 @@ struct t_http10
 			});
 		};
 		auto resolver = std::make_shared<boost::asio::ip::tcp::resolver>(a_io);
-		resolver->async_resolve({v_host, v_service}, [this, &a_io, check, send, resolver](auto a_ec, auto a_i) mutable
+		resolver->async_resolve(f_query(), [this, &a_io, check, send, resolver](auto a_ec, auto a_i) mutable
 		{
 			if (check(a_ec)) return;
 			if (v_service == "http") {
@@ -204,14 +909,16 @@ struct t_http10
 					if (!check(a_ec)) send(socket);
 				});
 			} else {
-				auto tls = std::make_shared<boost::asio::ssl::context>(boost::asio::ssl::context::tlsv12);
-				tls->set_default_verify_paths();
-				auto socket = std::make_shared<boost::asio::ssl::stream<boost::asio::ip::tcp::socket>>(a_io, *tls);
-				boost::asio::async_connect(socket->lowest_layer(), a_i, [check, send, tls, socket](auto a_ec, auto) mutable
+				auto socket = f_tls().f_stream(a_io);
+				boost::asio::async_connect(socket->lowest_layer(), a_i, [this, check, send, socket](auto a_ec, auto) mutable
 				{
-					if (!check(a_ec)) socket->async_handshake(boost::asio::ssl::stream_base::client, [check, send, socket](auto a_ec) mutable
+					if (check(a_ec)) return;
+					this->f_prepare(*socket);
+					socket->async_handshake(boost::asio::ssl::stream_base::client, [this, check, send, socket, t0 = std::chrono::steady_clock::now()](auto a_ec) mutable
 					{
-						if (!check(a_ec)) send(socket);
+						if (check(a_ec)) return;
+						this->f_tls().f_handshaken(socket->native_handle(), std::chrono::steady_clock::now() - t0);
+						send(socket);
 					});
 				});
 			}